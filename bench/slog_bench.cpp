@@ -0,0 +1,464 @@
+/*
+ * slog_bench: per-call latency percentiles and multi-threaded throughput for each logging style and built-in sink.
+ * The priority/ cases measure ERROR latency through an AsyncSink saturated with DEBUG, with and without priority lanes.
+ * The wakeup/ cases measure the CPU an idle or bursty AsyncSink burns and how long the first record of a burst takes to reach the
+ * target, with the default spin-then-park backend and with one that parks at once.
+ * The async_huge_null and async_node0_null cases repeat async_null with its rings on huge pages, and with its rings and backend thread
+ * on NUMA node 0. Run with taskset or numactl to put the logging threads on the same or another node.
+ * Results are printed to stdout as JSON, progress goes to stderr.
+ *
+ * usage: slog_bench [--samples N] [--ops N] [--max-threads N] [--filter SUBSTRING]
+ */
+#include <slog.hpp>
+#include <slog_async.hpp>
+#include <slog_json.hpp>
+#include <slog_static.hpp>
+#include <slog_trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+struct Options
+{
+    std::size_t samples = 20000;
+    std::size_t ops = 200000;
+    unsigned max_threads = 64;
+    std::string filter;
+};
+
+/** a cheap timestamp in ticks: the TSC on x86, nanoseconds elsewhere */
+inline std::uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+double calibrate_ticks_per_ns()
+{
+    auto t0 = std::chrono::steady_clock::now();
+    std::uint64_t c0 = ticks();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50))
+    {
+    }
+    std::uint64_t c1 = ticks();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    return double(c1 - c0) / double(ns);
+}
+
+/** collects results and prints them as a JSON document */
+class Report
+{
+private:
+    std::string body;
+public:
+    void add(const std::string &name, const std::vector<std::pair<const char *, double>> &values)
+    {
+        body += body.empty() ? "\n    " : ",\n    ";
+        body += "{\"name\":\"" + name + "\"";
+        for (const auto &v : values)
+        {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), ",\"%s\":%.6g", v.first, v.second);
+            body += buf;
+        }
+        body += "}";
+    }
+    void print(double ticks_per_ns) const
+    {
+        std::printf("{\n  \"ticks_per_ns\": %.6g,\n  \"results\": [%s\n  ]\n}\n", ticks_per_ns, body.c_str());
+    }
+};
+
+/** one logging statement against one sink */
+struct Case
+{
+    std::string name;
+    std::function<void(std::uint64_t)> op;
+    std::function<void()> flush;
+    std::function<void()> reset;
+};
+
+class NullSink : public slog::Sink
+{
+public:
+    void record(slog::Severity, const slog::Context &, const std::string &) override {}
+    void record_fields(slog::Severity, const slog::Context &, const std::string &, const slog::Fields &) override {}
+};
+
+// SLOG_STRIP_BELOW is read where SLOG expands, so raising it here strips this one statement as a release build would strip it
+#pragma push_macro("SLOG_STRIP_BELOW")
+#undef SLOG_STRIP_BELOW
+#define SLOG_STRIP_BELOW INFO
+template <typename S> void stripped_op(S &sink, std::uint64_t i)
+{
+    SLOG(DEBUG, sink) << "stripped " << i;
+}
+#pragma pop_macro("SLOG_STRIP_BELOW")
+
+template <typename S> void add_styles(std::vector<Case> &cases, const std::string &sink_name, S &sink, std::function<void()> flush = nullptr,
+                                      std::function<void()> reset = nullptr)
+{
+    cases.push_back(Case{"stream/" + sink_name, [&sink](std::uint64_t i) { SLOG(INFO, sink) << "stream style " << i << ' ' << 2.5; }, flush, reset});
+    cases.push_back(Case{"string/" + sink_name, [&sink](std::uint64_t) { SLOG(INFO, sink, "string style message of a typical length"); }, flush, reset});
+#if SLOG_FMT > 0
+    cases.push_back(Case{"fmt/" + sink_name, [&sink](std::uint64_t i) { SLOG(INFO, sink, "fmt style {} {}", i, 2.5); }, flush, reset});
+#endif
+    cases.push_back(Case{"kv/" + sink_name, [&sink](std::uint64_t i) { SLOG_KV(INFO, sink, "kv style", "i", i, "x", 2.5); }, flush, reset});
+    cases.push_back(Case{"cond_false/" + sink_name, [&sink](std::uint64_t i) { SLOG_IF(INFO, false, sink) << "cond false " << i; }, flush, reset});
+    // filtered by the runtime level: raised for the run, and put back by its flush
+    cases.push_back(Case{"filtered/" + sink_name, [&sink](std::uint64_t i) { SLOG(DEBUG, sink) << "filtered " << i; },
+                         [flush] {
+                             slog::set_min_severity(slog::Severity::DEBUG);
+                             if (flush)
+                             {
+                                 flush();
+                             }
+                         },
+                         [reset] {
+                             if (reset)
+                             {
+                                 reset();
+                             }
+                             slog::set_min_severity(slog::Severity::INFO);
+                         }});
+    cases.push_back(Case{"stripped/" + sink_name, [&sink](std::uint64_t i) { stripped_op(sink, i); }, flush, reset});
+}
+
+void run_latency(const Case &c, const Options &opt, double ticks_per_ns, Report &report)
+{
+    if (c.reset)
+    {
+        c.reset();
+    }
+    for (std::uint64_t i = 0; i < 1000; i++)
+    {
+        c.op(i);
+    }
+    std::vector<std::uint64_t> samples(opt.samples);
+    for (std::size_t i = 0; i < samples.size(); i++)
+    {
+        std::uint64_t t0 = ticks();
+        c.op(i);
+        samples[i] = ticks() - t0;
+    }
+    if (c.flush)
+    {
+        c.flush();
+    }
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) { return double(samples[std::min(samples.size() - 1, std::size_t(p * samples.size()))]) / ticks_per_ns; };
+    double sum = 0;
+    for (std::uint64_t s : samples)
+    {
+        sum += double(s);
+    }
+    report.add("latency/" + c.name, {{"threads", 1},
+                                     {"p50_ns", pct(0.50)},
+                                     {"p99_ns", pct(0.99)},
+                                     {"p999_ns", pct(0.999)},
+                                     {"mean_ns", sum / double(samples.size()) / ticks_per_ns}});
+}
+
+void run_throughput(const Case &c, const Options &opt, unsigned threads, Report &report)
+{
+    if (c.reset)
+    {
+        c.reset();
+    }
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    std::size_t per_thread = std::max<std::size_t>(1, opt.ops / threads);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&] {
+            ready++;
+            while (!go.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i < per_thread; i++)
+            {
+                c.op(i);
+            }
+        });
+    }
+    while (ready.load() != threads)
+    {
+        std::this_thread::yield();
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread &w : workers)
+    {
+        w.join();
+    }
+    // async sinks are only done once their backlog has been written
+    if (c.flush)
+    {
+        c.flush();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    report.add("throughput/" + c.name, {{"threads", threads}, {"ops", double(per_thread * threads)}, {"ops_per_sec", double(per_thread * threads) / secs}});
+}
+
+/** a target that takes about cost per record, and notes how long each ERROR record took to reach it */
+class SlowSink : public slog::Sink
+{
+private:
+    std::chrono::nanoseconds cost;
+public:
+    std::vector<double> error_latency_ns; /**< only touched by the backend thread until it's flushed */
+    explicit SlowSink(std::chrono::nanoseconds cost) : cost(cost) {}
+    void record(slog::Severity sev, const slog::Context &ctx, const std::string &) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (sev == slog::Severity::ERROR)
+        {
+            error_latency_ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::system_clock::now() - ctx.time).count());
+        }
+        while (std::chrono::steady_clock::now() - start < cost)
+        {
+        }
+    }
+};
+
+/** ERROR latency through a bounded, blocking AsyncSink while other threads flood it with DEBUG faster than its target can keep up */
+void run_priority(const std::string &name, bool lanes, Report &report)
+{
+    SlowSink slow(std::chrono::nanoseconds(500));
+    slog::AsyncOptions aopt;
+    aopt.capacity = 1 << 14;
+    aopt.overflow = slog::Overflow::BLOCK;
+    aopt.block_timeout = std::chrono::seconds(1);
+    aopt.priority_lanes = lanes;
+    slog::AsyncSink async(slow, aopt);
+    std::atomic<bool> done{false};
+    std::vector<std::thread> flood;
+    for (int t = 0; t < 2; t++)
+    {
+        flood.emplace_back([&] {
+            for (std::uint64_t i = 0; !done.load(std::memory_order_relaxed); i++)
+            {
+                SLOG(DEBUG, async) << "flood " << i;
+            }
+        });
+    }
+    for (int i = 0; i < 200; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        SLOG(ERROR, async, "error under flood");
+    }
+    done = true;
+    for (std::thread &t : flood)
+    {
+        t.join();
+    }
+    async.flush();
+    std::vector<double> &lat = slow.error_latency_ns;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) { return lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, std::size_t(p * lat.size()))]; };
+    report.add(name, {{"errors", double(lat.size())}, {"p50_ns", pct(0.50)}, {"p99_ns", pct(0.99)}, {"max_ns", lat.empty() ? 0.0 : lat.back()}});
+}
+
+/** notes how long the first record of each burst took to reach it */
+class WakeSink : public slog::Sink
+{
+public:
+    std::vector<double> latency_ns; /**< only touched by the backend thread until it's flushed */
+    void record(slog::Severity, const slog::Context &ctx, const std::string &msg) override
+    {
+        if (msg == "first")
+        {
+            latency_ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::system_clock::now() - ctx.time).count());
+        }
+    }
+};
+
+double cpu_seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+}
+
+/**
+ * CPU use and wake latency of an AsyncSink over one second, with a burst of 16 records every gap (or none at all for a zero gap).
+ * park_at_once turns off the idle spin and yield phases
+ */
+void run_wakeup(const std::string &name, std::chrono::milliseconds gap, bool park_at_once, Report &report)
+{
+    WakeSink wake;
+    slog::AsyncOptions aopt;
+    if (park_at_once)
+    {
+        aopt.idle_spin = std::chrono::microseconds(0);
+        aopt.idle_yield = std::chrono::microseconds(0);
+    }
+    slog::AsyncSink async(wake, aopt);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto t0 = std::chrono::steady_clock::now();
+    double cpu0 = cpu_seconds();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::seconds(1))
+    {
+        if (gap.count() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        std::this_thread::sleep_for(gap);
+        SLOG(INFO, async, "first");
+        for (int i = 1; i < 16; i++)
+        {
+            SLOG(INFO, async) << "burst " << i;
+        }
+    }
+    double cpu = cpu_seconds() - cpu0;
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    async.flush();
+    std::vector<double> &lat = wake.latency_ns;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) { return lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, std::size_t(p * lat.size()))]; };
+    report.add(name, {{"bursts", double(lat.size())}, {"cpu_pct", 100.0 * cpu / wall}, {"wake_p50_ns", pct(0.50)}, {"wake_p99_ns", pct(0.99)}});
+}
+
+Options parse(int argc, char **argv)
+{
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!std::strcmp(argv[i], "--samples"))
+        {
+            opt.samples = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (!std::strcmp(argv[i], "--ops"))
+        {
+            opt.ops = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (!std::strcmp(argv[i], "--max-threads"))
+        {
+            opt.max_threads = unsigned(std::strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[i], "--filter"))
+        {
+            opt.filter = argv[i + 1];
+        }
+    }
+    opt.samples = std::max<std::size_t>(opt.samples, 1);
+    return opt;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt = parse(argc, argv);
+    double ticks_per_ns = calibrate_ticks_per_ns();
+
+    std::FILE *dev_null = std::fopen("/dev/null", "w");
+    std::string tmpfs_path = (access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp") + std::string("/slog_bench.log");
+    std::FILE *tmpfs = std::fopen(tmpfs_path.c_str(), "w");
+    if (!dev_null || !tmpfs)
+    {
+        std::fprintf(stderr, "slog_bench: couldn't open /dev/null or %s\n", tmpfs_path.c_str());
+        return 1;
+    }
+    auto truncate_tmpfs = [tmpfs] {
+        std::fflush(tmpfs);
+        if (ftruncate(fileno(tmpfs), 0) == 0)
+        {
+            std::rewind(tmpfs);
+        }
+    };
+
+    NullSink null_sink;
+    slog::FileSink file_null(dev_null);
+    slog::FileSink file_tmpfs(tmpfs);
+    slog::JsonSink json_null(dev_null);
+    slog::TraceSink trace_null(dev_null);
+    NullSink async_target;
+    slog::AsyncSink async_null(async_target);
+    slog::AsyncOptions huge_opt;
+    huge_opt.huge_pages = true;
+    slog::AsyncSink async_huge_null(async_target, huge_opt);
+    slog::AsyncOptions node0_opt;
+    node0_opt.node = 0;
+    slog::AsyncSink async_node0_null(async_target, node0_opt);
+    slog::TeeSink tee;
+    tee.add(null_sink).add(file_null, slog::Severity::WARN);
+    slog::MinSeverity<slog::Severity::DEBUG, slog::Format<slog::Pattern, slog::FileWriter>> static_null(slog::Pattern(), dev_null);
+
+    std::vector<Case> cases;
+    add_styles(cases, "null", null_sink);
+    add_styles(cases, "file_devnull", file_null);
+    add_styles(cases, "file_tmpfs", file_tmpfs, nullptr, truncate_tmpfs);
+    add_styles(cases, "json_devnull", json_null);
+    add_styles(cases, "trace_devnull", trace_null);
+    add_styles(cases, "async_null", async_null, [&] { async_null.flush(); });
+    add_styles(cases, "async_huge_null", async_huge_null, [&] { async_huge_null.flush(); });
+    add_styles(cases, "async_node0_null", async_node0_null, [&] { async_node0_null.flush(); });
+    add_styles(cases, "tee_null", tee);
+    add_styles(cases, "static_devnull", static_null);
+
+    Report report;
+    for (const Case &c : cases)
+    {
+        if (c.name.find(opt.filter) == std::string::npos)
+        {
+            continue;
+        }
+        std::fprintf(stderr, "slog_bench: %s\n", c.name.c_str());
+        run_latency(c, opt, ticks_per_ns, report);
+        for (unsigned threads = 1; threads <= opt.max_threads; threads *= 2)
+        {
+            run_throughput(c, opt, threads, report);
+        }
+    }
+    const std::pair<const char *, bool> priority[] = {{"priority/fifo", false}, {"priority/lanes", true}};
+    for (const auto &p : priority)
+    {
+        if (std::string(p.first).find(opt.filter) != std::string::npos)
+        {
+            std::fprintf(stderr, "slog_bench: %s\n", p.first);
+            run_priority(p.first, p.second, report);
+        }
+    }
+    struct Wakeup
+    {
+        const char *name;
+        int gap_ms;
+        bool park_at_once;
+    };
+    const Wakeup wakeups[] = {{"wakeup/idle/adaptive", 0, false},       {"wakeup/idle/park", 0, true},
+                              {"wakeup/bursty_1ms/adaptive", 1, false}, {"wakeup/bursty_1ms/park", 1, true},
+                              {"wakeup/bursty_20ms/adaptive", 20, false}, {"wakeup/bursty_20ms/park", 20, true}};
+    for (const Wakeup &w : wakeups)
+    {
+        if (std::string(w.name).find(opt.filter) != std::string::npos)
+        {
+            std::fprintf(stderr, "slog_bench: %s\n", w.name);
+            run_wakeup(w.name, std::chrono::milliseconds(w.gap_ms), w.park_at_once, report);
+        }
+    }
+    report.print(ticks_per_ns);
+    std::fclose(tmpfs);
+    std::remove(tmpfs_path.c_str());
+    return 0;
+}
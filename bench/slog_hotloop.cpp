@@ -0,0 +1,102 @@
+/*
+ * slog_hotloop: the cost SLOG call sites add to a hot loop in which they're never taken. Built twice, as slog_hotloop_outline
+ * (SLOG_OUTLINE=1, the default) and slog_hotloop_inline (SLOG_OUTLINE=0), so the two can be compared.
+ * Prints one JSON object to stdout: the code size of the loop function, the size of the binary, and ns per iteration.
+ *
+ * usage: slog_hotloop [--iters N]
+ */
+#include <slog.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#if defined(__GNUC__) && defined(__linux__)
+// each loop goes in its own section, so its code size can be read off the linker's __start_/__stop_ symbols
+#define HOTLOOP_SECTION(NAME) __attribute__((noinline, section(#NAME)))
+extern "C" const char __start_slog_hot_plain[], __stop_slog_hot_plain[], __start_slog_hot_logged[], __stop_slog_hot_logged[];
+#define HOTLOOP_SIZE(NAME) static_cast<long>(__stop_##NAME - __start_##NAME)
+#else
+#define HOTLOOP_SECTION(NAME) __attribute__((noinline))
+#define HOTLOOP_SIZE(NAME) -1L
+#endif
+
+namespace
+{
+class NullSink : public slog::Sink
+{
+public:
+    void record(slog::Severity, const slog::Context &, const std::string &) override {}
+};
+
+/** the loop without logging, as a baseline */
+HOTLOOP_SECTION(slog_hot_plain) std::uint64_t plain_loop(std::uint64_t iters, std::uint64_t seed)
+{
+    std::uint64_t acc = seed;
+    for (std::uint64_t i = 0; i < iters; i++)
+    {
+        acc = acc * 6364136223846793005ULL + i;
+        acc ^= acc >> 29;
+    }
+    return acc;
+}
+
+/** the same loop with a handful of typical statements, gated on a flag that's false at runtime */
+HOTLOOP_SECTION(slog_hot_logged) std::uint64_t logged_loop(std::uint64_t iters, std::uint64_t seed, bool verbose, slog::Sink &sink)
+{
+    std::uint64_t acc = seed;
+    for (std::uint64_t i = 0; i < iters; i++)
+    {
+        acc = acc * 6364136223846793005ULL + i;
+        SLOG_IF(DEBUG, verbose, sink) << "step " << i << " acc " << acc;
+        acc ^= acc >> 29;
+        SLOG_IF(INFO, verbose && (acc & 0xFF) == 0, sink, "low byte clear");
+        SLOG_IF(WARN, verbose && acc == 0, sink) << "acc hit zero at " << i;
+    }
+    return acc;
+}
+
+double ns_per_iter(std::uint64_t (*loop)(std::uint64_t, std::uint64_t, bool, slog::Sink &), std::uint64_t iters, slog::Sink &sink,
+                   std::uint64_t &sink_hole)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    sink_hole += loop(iters, sink_hole, false, sink);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / double(iters);
+}
+std::uint64_t plain_adapter(std::uint64_t iters, std::uint64_t seed, bool, slog::Sink &) { return plain_loop(iters, seed); }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::uint64_t iters = 200000000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!std::strcmp(argv[i], "--iters"))
+        {
+            iters = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+    NullSink sink;
+    std::uint64_t hole = static_cast<std::uint64_t>(argc);
+    // warm up both, then take the best of a few runs
+    ns_per_iter(plain_adapter, iters / 10, sink, hole);
+    ns_per_iter(logged_loop, iters / 10, sink, hole);
+    double plain = 1e9, logged = 1e9;
+    for (int run = 0; run < 5; run++)
+    {
+        double p = ns_per_iter(plain_adapter, iters, sink, hole);
+        double l = ns_per_iter(logged_loop, iters, sink, hole);
+        plain = p < plain ? p : plain;
+        logged = l < logged ? l : logged;
+    }
+    struct stat st;
+    long binary_bytes = stat("/proc/self/exe", &st) == 0 ? static_cast<long>(st.st_size) : -1L;
+    std::printf("{\"outline\":%d,\"plain_loop_bytes\":%ld,\"logged_loop_bytes\":%ld,\"binary_bytes\":%ld,\"plain_ns_per_iter\":%.4f,"
+                "\"logged_ns_per_iter\":%.4f,\"checksum\":%llu}\n",
+                SLOG_OUTLINE, HOTLOOP_SIZE(slog_hot_plain), HOTLOOP_SIZE(slog_hot_logged), binary_bytes, plain, logged,
+                static_cast<unsigned long long>(hole));
+    return 0;
+}
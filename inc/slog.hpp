@@ -22,6 +22,10 @@
 #else
 #define SLOG_FILE_SINK_DEFAULT 0
 #endif
+/** the line layout used by FileSink when none is given. See slog::Pattern for the syntax */
+#ifndef SLOG_FILE_SINK_PATTERN
+#define SLOG_FILE_SINK_PATTERN "{time}\t{sev}\t{msg}{tags}"
+#endif
 /** sets whether fmt-lib style logging is supported (0 for disabled, 1 for fmtlib, 2 for stdfmt) */
 #ifndef SLOG_FMT
 #define SLOG_FMT 1*(__cplusplus >= 201703L && __has_include(<fmt/format.h>))
@@ -34,21 +38,74 @@
 #ifndef SLOG_STRIP_BELOW
 #define SLOG_STRIP_BELOW DEBUG
 #endif
+/** sets whether the logger keeps counters and record() latency histograms about itself (see slog::metrics_snapshot) */
+#ifndef SLOG_METRICS
+#define SLOG_METRICS 0
+#endif
+/** sets whether record building is kept out of line in cold functions, so SLOG call sites only expand to the enabled check */
+#ifndef SLOG_OUTLINE
+#define SLOG_OUTLINE 1
+#endif
 #define SLOG_CTX_SRC (1 << 0)
 #define SLOG_CTX_TIME (1 << 1)
 #define SLOG_CTX_THREAD (1 << 2)
+#define SLOG_CTX_TAGS (1 << 3)
+#define SLOG_CTX_SEQ (1 << 4)
 #ifndef SLOG_CTX_MASK
 /** combine the appropriate SLOG_CTX_* to define what will be included in the slog::Context struct */
-#define SLOG_CTX_MASK (SLOG_CTX_SRC | SLOG_CTX_TIME | SLOG_CTX_THREAD)
+#define SLOG_CTX_MASK (SLOG_CTX_SRC | SLOG_CTX_TIME | SLOG_CTX_THREAD | SLOG_CTX_TAGS | SLOG_CTX_SEQ)
+#endif
+/** how many ScopedTags a thread can have alive, counting ones kept alive by queued records, before new ones go on the heap */
+#ifndef SLOG_TAG_FRAMES
+#define SLOG_TAG_FRAMES 32
+#endif
+/** how many bytes of a string ScopedTag value are kept. Longer values are cut short */
+#ifndef SLOG_TAG_TEXT
+#define SLOG_TAG_TEXT 48
+#endif
+/** sets whether per call site record/byte counts can be turned on at runtime (see slog::site_stats_enable). Needs SLOG_CTX_SRC */
+#ifndef SLOG_SITE_STATS
+#define SLOG_SITE_STATS ((SLOG_CTX_MASK & SLOG_CTX_SRC) != 0)
+#endif
+/** how many call sites the site stats table can track. Must be a power of 2 */
+#ifndef SLOG_SITE_STATS_SLOTS
+#define SLOG_SITE_STATS_SLOTS 1024
+#endif
+/** sets whether slog::shutdown runs at exit, once an AsyncSink, TraceSink or MetricsReporter has been made */
+#ifndef SLOG_SHUTDOWN_AT_EXIT
+#define SLOG_SHUTDOWN_AT_EXIT 1
+#endif
+/** how long the shutdown at exit waits for async sinks to drain before leaving them behind, in milliseconds */
+#ifndef SLOG_SHUTDOWN_TIMEOUT_MS
+#define SLOG_SHUTDOWN_TIMEOUT_MS 1000
+#endif
+/** sets whether async sinks park their backend threads around fork() and start a new one in the child */
+#ifndef SLOG_ATFORK
+#if defined(__unix__) || defined(__APPLE__)
+#define SLOG_ATFORK 1
+#else
+#define SLOG_ATFORK 0
+#endif
+#endif
+/** how long fork() waits for an async sink's backend to step out of its target before forking with the records behind it still queued */
+#ifndef SLOG_FORK_TIMEOUT_MS
+#define SLOG_FORK_TIMEOUT_MS 1000
 #endif
 
 /* end options, begin actual code*/
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
-#if SLOG_DEFAULT_FILE_SINK == 1
-#include <cstdio>
-#endif
 #if SLOG_FMT == 1
 #define SLOG_FMT_NS fmt
 #include <fmt/format.h>
@@ -56,11 +113,28 @@
 #define SLOG_FMT_NS std
 #include <format>
 #endif
-#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
 #include <chrono>
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+#include <ctime>
 #endif
-#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
-#include <thread>
+#if SLOG_ATFORK == 1
+#include <pthread.h>
+#endif
+
+#if SLOG_OUTLINE == 1 && (defined(__GNUC__) || defined(__clang__))
+#define SLOG_OUTLINED __attribute__((noinline, cold))
+#define SLOG_LIKELY(X) __builtin_expect(!!(X), 1)
+#elif SLOG_OUTLINE == 1 && defined(_MSC_VER)
+#define SLOG_OUTLINED __declspec(noinline)
+#define SLOG_LIKELY(X) (X)
+#else
+#define SLOG_OUTLINED
+#define SLOG_LIKELY(X) (X)
+#endif
+#if SLOG_OUTLINE == 1 && __cplusplus >= 202002L
+#define SLOG_COLD_BRANCH [[unlikely]]
+#else
+#define SLOG_COLD_BRANCH
 #endif
 
 namespace slog
@@ -85,6 +159,215 @@ inline const char *severity_to_str(Severity sev)
     default: return "?";
     }
 }
+/** A typed key/value pair attached to a record. Keys and string values are borrowed, not copied */
+struct Field
+{
+    enum class Type
+    {
+        INT,
+        UINT,
+        DOUBLE,
+        BOOL,
+        STRING
+    };
+    const char *key;
+    Type type;
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        bool b;
+        struct
+        {
+            const char *data;
+            std::size_t size;
+        } str;
+    };
+};
+/** A read-only view over the fields of a record */
+class Fields
+{
+private:
+    const Field *first;
+    std::size_t count;
+public:
+    Fields(const Field *first = nullptr, std::size_t count = 0) : first(first), count(count) {};
+    const Field *begin() const { return first; }
+    const Field *end() const { return first + count; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Field &operator[](std::size_t i) const { return first[i]; }
+};
+
+namespace detail
+{
+struct TagPool;
+/** one ScopedTag. Frames are reused from a per-thread pool and stay alive while queued records still refer to them */
+struct TagFrame
+{
+    Field field;
+    const TagFrame *parent;
+    TagPool *pool; /**< null for frames made on the heap because the pool ran out */
+    TagFrame *next;
+    mutable std::atomic<unsigned int> refs;
+    char text[SLOG_TAG_TEXT];
+};
+/** the innermost ScopedTag of this thread */
+inline const TagFrame *&current_tag()
+{
+    static thread_local const TagFrame *top = nullptr;
+    return top;
+}
+inline void release_tag(const TagFrame *frame);
+} // namespace detail
+/**
+ * A read-only view of the ScopedTags that were in scope when a record was made, iterated innermost first.
+ * The tags are only guaranteed to live until record() returns; a sink that keeps the Context longer must retain() it and release() it after
+ */
+class Tags
+{
+private:
+    const detail::TagFrame *top;
+public:
+    class iterator
+    {
+    private:
+        const detail::TagFrame *frame;
+    public:
+        iterator(const detail::TagFrame *frame) : frame(frame) {};
+        const Field &operator*() const { return frame->field; }
+        const Field *operator->() const { return &frame->field; }
+        iterator &operator++()
+        {
+            frame = frame->parent;
+            return *this;
+        }
+        bool operator==(const iterator &other) const { return frame == other.frame; }
+        bool operator!=(const iterator &other) const { return frame != other.frame; }
+    };
+    Tags(const detail::TagFrame *top = nullptr) : top(top) {};
+    iterator begin() const { return iterator(top); }
+    iterator end() const { return iterator(nullptr); }
+    bool empty() const { return top == nullptr; }
+    /** the innermost frame, for sinks that render tags outermost first via its parent links */
+    const detail::TagFrame *innermost() const { return top; }
+    /** keeps every tag in view alive until a matching release(). Only valid while they're already alive, e.g. inside record() */
+    void retain() const
+    {
+        for (const detail::TagFrame *f = top; f != nullptr; f = f->parent)
+        {
+            f->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void release() const
+    {
+        for (const detail::TagFrame *f = top; f != nullptr;)
+        {
+            // read the parent first, the frame may be recycled once it's released
+            const detail::TagFrame *parent = f->parent;
+            detail::release_tag(f);
+            f = parent;
+        }
+    }
+};
+
+namespace detail
+{
+/**
+ * The runtime levels. word packs the lowest (bits 8-15) and highest (bits 0-7) level any thread currently filters at, i.e. the global
+ * level and every ScopedSeverity override, so a record outside that range is decided by one relaxed load and no thread local access
+ */
+struct Levels
+{
+    std::atomic<int> word{0};
+    std::atomic<int> global{0};
+    std::mutex mtx;        /**< serialises changes, which are rare */
+    int overrides[4] = {}; /**< live ScopedSeverity guards at each level */
+    /** recomputes word. Called with mtx held */
+    void update()
+    {
+        int g = global.load(std::memory_order_relaxed), lo = g, hi = g;
+        for (int i = 0; i < 4; i++)
+        {
+            lo = overrides[i] > 0 && i < lo ? i : lo;
+            hi = overrides[i] > 0 && i > hi ? i : hi;
+        }
+        word.store((lo << 8) | hi, std::memory_order_relaxed);
+    }
+};
+inline Levels &levels()
+{
+    static Levels l;
+    return l;
+}
+/** the calling thread's ScopedSeverity level, or -1 */
+inline int &thread_level()
+{
+    static thread_local int level = -1;
+    return level;
+}
+/** the exact check, for a record between the lowest and highest level in use while some thread has an override */
+SLOG_OUTLINED inline bool thread_enabled(int sev)
+{
+    int level = thread_level();
+    return sev >= (level >= 0 ? level : levels().global.load(std::memory_order_relaxed));
+}
+/**
+ * true when sev passes the runtime filter: the calling thread's ScopedSeverity if it has one, otherwise the global level. This is the
+ * check SLOG makes before evaluating any of its arguments. With no overrides anywhere the two bounds are equal and it's one compare.
+ * While any thread has one, every thread pays for the thread_enabled call on records between the bounds, whether it overrides or not
+ */
+inline bool runtime_enabled(Severity sev)
+{
+    int word = levels().word.load(std::memory_order_relaxed);
+    int s = static_cast<int>(sev);
+    // s < lowest, as one compare against a constant since sev is known at the call site
+    if (((s << 8) | 0xFF) < word)
+    {
+        return false;
+    }
+    return s >= (word & 0xFF) || thread_enabled(s);
+}
+} // namespace detail
+/** drops records below sev everywhere, before any of their arguments are evaluated. Defaults to DEBUG */
+inline void set_min_severity(Severity sev)
+{
+    detail::Levels &l = detail::levels();
+    std::lock_guard<std::mutex> lock(l.mtx);
+    l.global.store(static_cast<int>(sev), std::memory_order_relaxed);
+    l.update();
+}
+inline Severity min_severity() { return static_cast<Severity>(detail::levels().global.load(std::memory_order_relaxed)); }
+/**
+ * Overrides the minimum severity for the calling thread while in scope, e.g. slog::ScopedSeverity debug(slog::Severity::DEBUG) to see
+ * everything one request does. Takes precedence over slog::set_min_severity, and nests
+ */
+class ScopedSeverity
+{
+private:
+    int previous;
+    static void count(int level, int delta)
+    {
+        detail::Levels &l = detail::levels();
+        std::lock_guard<std::mutex> lock(l.mtx);
+        l.overrides[level] += delta;
+        l.update();
+    }
+public:
+    explicit ScopedSeverity(Severity sev) : previous(detail::thread_level())
+    {
+        count(static_cast<int>(sev), 1);
+        detail::thread_level() = static_cast<int>(sev);
+    }
+    ScopedSeverity(const ScopedSeverity &) = delete;
+    ScopedSeverity &operator=(const ScopedSeverity &) = delete;
+    ~ScopedSeverity()
+    {
+        int level = detail::thread_level();
+        detail::thread_level() = previous;
+        count(level, -1);
+    }
+};
 /** Context of each log message */
 struct Context
 {
@@ -100,6 +383,12 @@ public:
 #if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
     std::thread::id thread_id;
 #endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+    Tags tags;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+    unsigned long long seq; /**< counts the records made on this thread, so their order survives sinks that reorder */
+#endif
 };
 
 inline Context make_ctx(const char *file_name, unsigned int line, const char *func_name)
@@ -115,99 +404,1506 @@ inline Context make_ctx(const char *file_name, unsigned int line, const char *fu
 #endif
 #if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
     ctx.thread_id = std::this_thread::get_id();
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+    ctx.tags = Tags(detail::current_tag());
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+    static thread_local unsigned long long seq = 0;
+    ctx.seq = seq++;
 #endif
     return ctx;
 }
 
-/** An interface for a log sink. Implement the record method */
-class Sink
+namespace detail
 {
-public:
-    virtual void record(Severity sev, const Context &ctx, const std::string &msg) = 0;
+/** appends the decimal digits of v, left padded with zeros to at least width digits */
+inline void append_uint(std::string &out, unsigned long long v, unsigned int width = 0)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    do
+    {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (static_cast<unsigned int>(end - p) < width)
+    {
+        *--p = '0';
+    }
+    out.append(p, end);
+}
+/** appends the value of a field as text, without quoting */
+inline void append_field_value(std::string &out, const Field &f)
+{
+    switch (f.type)
+    {
+    case Field::Type::INT:
+        if (f.i < 0)
+        {
+            out += '-';
+        }
+        append_uint(out, f.i < 0 ? 0ULL - static_cast<unsigned long long>(f.i) : static_cast<unsigned long long>(f.i));
+        break;
+    case Field::Type::UINT: append_uint(out, f.u); break;
+    case Field::Type::DOUBLE:
+    {
+        char buf[32];
+        out.append(buf, static_cast<std::size_t>(std::snprintf(buf, sizeof(buf), "%.15g", f.d)));
+        break;
+    }
+    case Field::Type::BOOL: out += f.b ? "true" : "false"; break;
+    case Field::Type::STRING: out.append(f.str.data, f.str.size); break;
+    }
+}
+/**
+ * appends fields as logfmt, i.e. " key=value", quoting string values that contain spaces, quotes, '=' or control bytes. Inside quotes
+ * control bytes are escaped, so a value can't start a line of its own
+ */
+inline void append_logfmt(std::string &out, const Fields &fields)
+{
+    for (const Field &f : fields)
+    {
+        out += ' ';
+        out += f.key;
+        out += '=';
+        bool quote = f.type == Field::Type::STRING && f.str.size == 0;
+        for (std::size_t i = 0; f.type == Field::Type::STRING && i < f.str.size && !quote; i++)
+        {
+            unsigned char c = static_cast<unsigned char>(f.str.data[i]);
+            quote = c == ' ' || c == '"' || c == '=' || c < 0x20 || c == 0x7f;
+        }
+        if (!quote)
+        {
+            append_field_value(out, f);
+            continue;
+        }
+        out += '"';
+        for (std::size_t i = 0; i < f.str.size; i++)
+        {
+            unsigned char c = static_cast<unsigned char>(f.str.data[i]);
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20 || c == 0x7f)
+                {
+                    static const char hex[] = "0123456789abcdef";
+                    out += "\\x";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xf];
+                }
+                else
+                {
+                    out += static_cast<char>(c);
+                }
+            }
+        }
+        out += '"';
+    }
+}
+inline Field make_field(const char *key, bool v)
+{
+    Field f;
+    f.key = key;
+    f.type = Field::Type::BOOL;
+    f.b = v;
+    return f;
+}
+inline Field make_field(const char *key, double v)
+{
+    Field f;
+    f.key = key;
+    f.type = Field::Type::DOUBLE;
+    f.d = v;
+    return f;
+}
+inline Field make_field(const char *key, const char *v, std::size_t size)
+{
+    Field f;
+    f.key = key;
+    f.type = Field::Type::STRING;
+    f.str.data = v;
+    f.str.size = size;
+    return f;
+}
+inline Field make_field(const char *key, const char *v) { return make_field(key, v, std::strlen(v)); }
+inline Field make_field(const char *key, const std::string &v) { return make_field(key, v.data(), v.size()); }
+inline Field make_field(const char *key, float v) { return make_field(key, static_cast<double>(v)); }
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, Field>::type make_field(const char *key, T v)
+{
+    Field f;
+    f.key = key;
+    if (std::is_signed<T>::value)
+    {
+        f.type = Field::Type::INT;
+        f.i = static_cast<long long>(v);
+    }
+    else
+    {
+        f.type = Field::Type::UINT;
+        f.u = static_cast<unsigned long long>(v);
+    }
+    return f;
+}
+inline void fill_fields(Field *) {}
+template <typename V, typename... KV> inline void fill_fields(Field *out, const char *key, const V &v, const KV &...kv)
+{
+    *out = make_field(key, v);
+    fill_fields(out + 1, kv...);
+}
+/**
+ * A thread's ScopedTag frames. Only the owning thread takes frames; frames released on other threads (after a queued record is done
+ * with them) come back through the returned stack. The pool outlives its thread until every such frame is back
+ */
+struct TagPool
+{
+    TagFrame frames[SLOG_TAG_FRAMES];
+    TagFrame *free_list = nullptr; /**< owner only */
+    std::atomic<TagFrame *> returned{nullptr};
+    std::atomic<unsigned int> users{1}; /**< the owning thread, plus frames whose last reference is held elsewhere */
+    TagPool()
+    {
+        for (TagFrame &f : frames)
+        {
+            f.pool = this;
+            f.next = free_list;
+            free_list = &f;
+        }
+    }
+    static void unuse(TagPool *pool)
+    {
+        if (pool->users.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete pool;
+        }
+    }
 };
-/** A temporary object that exposes a stringstream for logging */
-class LogObjStream
+/** the calling thread's pool, made on its first ScopedTag */
+inline TagPool &tag_pool()
+{
+    struct Holder
+    {
+        TagPool *pool = nullptr;
+        ~Holder()
+        {
+            if (pool != nullptr)
+            {
+                TagPool::unuse(pool);
+            }
+        }
+    };
+    static thread_local Holder holder;
+    if (holder.pool == nullptr)
+    {
+        holder.pool = new TagPool();
+    }
+    return *holder.pool;
+}
+/** recycles a frame whose last reference is gone, from any thread */
+inline void free_tag(TagFrame *frame)
+{
+    TagPool *pool = frame->pool;
+    if (pool == nullptr)
+    {
+        delete frame;
+        return;
+    }
+    frame->next = pool->returned.load(std::memory_order_relaxed);
+    while (!pool->returned.compare_exchange_weak(frame->next, frame, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    TagPool::unuse(pool);
+}
+inline void release_tag(const TagFrame *frame)
+{
+    if (frame->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        free_tag(const_cast<TagFrame *>(frame));
+    }
+}
+/** makes field the calling thread's innermost tag, copying a string value into the frame */
+inline TagFrame *push_tag(const Field &field)
+{
+    TagPool &pool = tag_pool();
+    if (pool.free_list == nullptr)
+    {
+        pool.free_list = pool.returned.exchange(nullptr, std::memory_order_acquire);
+    }
+    TagFrame *frame = pool.free_list;
+    if (frame != nullptr)
+    {
+        pool.free_list = frame->next;
+    }
+    else
+    {
+        frame = new TagFrame();
+        frame->pool = nullptr;
+    }
+    frame->field = field;
+    if (field.type == Field::Type::STRING)
+    {
+        std::size_t size = std::min<std::size_t>(field.str.size, SLOG_TAG_TEXT);
+        std::memcpy(frame->text, field.str.data, size);
+        frame->field.str.data = frame->text;
+        frame->field.str.size = size;
+    }
+    frame->parent = current_tag();
+    frame->refs.store(1, std::memory_order_relaxed);
+    current_tag() = frame;
+    return frame;
+}
+/** undoes push_tag. A frame nothing else refers to goes straight back on the free list without any atomic read-modify-write */
+inline void pop_tag(TagFrame *frame)
+{
+    current_tag() = frame->parent;
+    // only a holder can add a reference, so if this thread holds the only one nobody else can race with it
+    if (frame->refs.load(std::memory_order_acquire) == 1 && frame->pool != nullptr)
+    {
+        frame->next = frame->pool->free_list;
+        frame->pool->free_list = frame;
+        return;
+    }
+    if (frame->pool != nullptr)
+    {
+        frame->pool->users.fetch_add(1, std::memory_order_relaxed);
+    }
+    release_tag(frame);
+}
+/** appends the tags outermost first as logfmt, i.e. " key=value" */
+inline void append_tags(std::string &out, const TagFrame *frame)
+{
+    if (frame != nullptr)
+    {
+        append_tags(out, frame->parent);
+        append_logfmt(out, Fields(&frame->field, 1));
+    }
+}
+/** a streambuf that appends to a std::string */
+class StringBuf : public std::streambuf
 {
 private:
-    const Context ctx;
-    const Severity sev;
-    Sink &sink;
-    std::ostringstream msg;
+    std::string &out;
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            out.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        out.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
 public:
-    LogObjStream(Context &&ctx, Severity sev, Sink &sink) : ctx(ctx), sev(sev), sink(sink) {};
-    LogObjStream(LogObjStream &&) = default;
-    template <typename T> LogObjStream &operator<<(const T &t)
+    explicit StringBuf(std::string &out) : out(out) {};
+};
+/** a string and a stream writing into it, which a record's message is built in */
+struct Scratch
+{
+    std::string str;
+    StringBuf buf;
+    std::ostream os;
+    Scratch() : buf(str), os(&buf) {};
+    void reset()
     {
-        msg << t;
-        return *this;
+        str.clear();
+        os.clear();
+        os.flags(std::ios_base::dec | std::ios_base::skipws);
+        os.precision(6);
+        os.width(0);
+        os.fill(' ');
     }
-    ~LogObjStream() { sink.record(sev, ctx, msg.str()); }
 };
-
-#if SLOG_FILE_SINK == 1
-/** An implementation of the sink that goes to a FILE* */
-class FileSink : public Sink
+/**
+ * Borrows one of the calling thread's Scratch buffers, which keep their capacity between records so steady state logging doesn't
+ * allocate. Leases nest (e.g. a sink that logs), and past SCRATCH_DEPTH levels a fresh Scratch is allocated instead.
+ */
+class ScratchLease
 {
 private:
-    std::FILE *file;
-    bool close_dtor;
+    static const unsigned SCRATCH_DEPTH = 4;
+    /** buffers that grew past this are released rather than kept around for the life of the thread */
+    static const std::size_t SCRATCH_KEEP = 1 << 16;
+    Scratch *scratch;
+    bool owned;
+    static unsigned &depth()
+    {
+        static thread_local unsigned depth = 0;
+        return depth;
+    }
 public:
-    FileSink(std::FILE *file = stderr, bool close_dtor = false) : file(file), close_dtor(close_dtor) {};
-    void record(Severity sev, const Context &ctx, const std::string &msg) override
+    ScratchLease()
     {
-        char time_str[32];
-        std::time_t time = std::chrono::system_clock::to_time_t(ctx.time);
-        std::tm time_buf;
-        std::strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S", ::localtime_r(&time, &time_buf));
-        fprintf(file, "%s\t%s\t%s\n", time_str, severity_to_str(sev), msg.c_str());
+        static thread_local Scratch pool[SCRATCH_DEPTH];
+        owned = depth() >= SCRATCH_DEPTH;
+        scratch = owned ? new Scratch() : &pool[depth()++];
+        scratch->reset();
     }
-    ~FileSink()
+    ScratchLease(ScratchLease &&other) : scratch(other.scratch), owned(other.owned) { other.scratch = nullptr; }
+    ScratchLease(const ScratchLease &) = delete;
+    ScratchLease &operator=(const ScratchLease &) = delete;
+    ~ScratchLease()
     {
-        if (close_dtor)
+        if (scratch == nullptr)
         {
-            fclose(file);
+            return;
+        }
+        if (owned)
+        {
+            delete scratch;
+            return;
         }
+        if (scratch->str.capacity() > SCRATCH_KEEP)
+        {
+            std::string().swap(scratch->str);
+        }
+        depth()--;
     }
+    Scratch *get() const { return scratch; }
+    Scratch *operator->() const { return scratch; }
 };
-#endif
-#if SLOG_FILE_SINK_DEFAULT == 1
-inline Sink &DEFAULT_SINK()
+/** the message as a std::string, copying a C string into the lease's buffer so no temporary is allocated */
+inline const std::string &as_msg(const std::string &msg, ScratchLease &) { return msg; }
+inline const std::string &as_msg(const char *msg, ScratchLease &lease)
 {
-    static FileSink sink;
-    return sink;
+    lease->str.assign(msg);
+    return lease->str;
 }
-#else
-extern Sink &DEFAULT_SINK();
-#endif
+} // namespace detail
 
-inline LogObjStream log_impl(Context &&ctx, Severity sev, Sink &sink = DEFAULT_SINK())
+/** An interface for a log sink. Implement the record method */
+class Sink
 {
-    return LogObjStream(std::move(ctx), sev, sink);
+private:
+    std::atomic<int> level{0};
+public:
+    Sink() = default;
+    Sink(const Sink &other) : level(other.level.load(std::memory_order_relaxed)) {};
+    Sink &operator=(const Sink &other)
+    {
+        level.store(other.level.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+    /** drops records below sev sent to this sink. Unlike slog::set_min_severity, their messages have already been built by then */
+    void set_min_severity(Severity sev) { level.store(static_cast<int>(sev), std::memory_order_relaxed); }
+    Severity min_severity() const { return static_cast<Severity>(level.load(std::memory_order_relaxed)); }
+    virtual void record(Severity sev, const Context &ctx, const std::string &msg) = 0;
+    /** records a message with structured fields. Unless overridden, the fields are appended to msg as logfmt */
+    virtual void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        detail::ScratchLease line;
+        line->str.assign(msg);
+        detail::append_logfmt(line->str, fields);
+        record(sev, ctx, line->str);
+    }
+    /** writes out anything the sink has buffered. slog::shutdown calls it on the default sink and on async sinks' targets */
+    virtual void flush() {}
 };
-
-inline void log_impl(Context &&ctx, Severity sev, const std::string &msg)
+/** Base class for sinks that are called statically instead of through Sink's vtable. Derived must define record() */
+struct StaticSinkTag
 {
-    DEFAULT_SINK().record(sev, ctx, msg);
 };
-inline void log_impl(Context &&ctx, Severity sev, Sink &sink, const std::string &msg)
+template <typename Derived> class StaticSink : public StaticSinkTag
 {
-    sink.record(sev, ctx, msg);
+public:
+    /** unless Derived defines its own, the fields are appended to msg as logfmt */
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        detail::ScratchLease line;
+        line->str.assign(msg);
+        detail::append_logfmt(line->str, fields);
+        static_cast<Derived *>(this)->record(sev, ctx, line->str);
+    }
 };
-
-#if SLOG_FMT == 1 || SLOG_FMT == 2
-template <typename... T> inline void log_impl(Context &&ctx, Severity sev, SLOG_FMT_NS::format_string<T...> fmt, T &&...args)
+namespace detail
+{
+/** the type a log call binds to: Sink for anything virtual, otherwise the static sink itself */
+template <typename S> struct sink_target
 {
-    DEFAULT_SINK().record(sev, ctx, SLOG_FMT_NS::format(fmt, std::forward<T>(args)...));
+    typedef typename std::conditional<std::is_base_of<Sink, S>::value, Sink, S>::type type;
 };
-template <typename... T> inline void log_impl(Context &&ctx, Sink &sink, Severity sev, SLOG_FMT_NS::format_string<T...> fmt, T &&...args)
+template <typename S> struct is_sink : std::integral_constant<bool, std::is_base_of<Sink, S>::value || std::is_base_of<StaticSinkTag, S>::value>
 {
-    sink.record(sev, ctx, SLOG_FMT_NS::format(fmt, std::forward<T>(args)...));
 };
-#endif
-} // namespace slog
-// clang-format off
-#define SLOG_IF(SEV, COND, ...) if(!COND || (slog::Severity::SEV < slog::Severity::SLOG_STRIP_BELOW)){;} else \
-    slog::log_impl(slog::make_ctx(__FILE__, __LINE__, __FUNCTION__), slog::Severity::SEV, ##__VA_ARGS__)
-#define SLOG(SEV, ...) SLOG_IF(SEV, true, ##__VA_ARGS__)
+/** true when a sink's own minimum severity lets sev through. Static sinks filter with MinSeverity instead */
+inline bool sink_enabled(const Sink &sink, Severity sev) { return sev >= sink.min_severity(); }
+inline bool sink_enabled(const StaticSinkTag &, Severity) { return true; }
+/** what SLOG_ENABLED checks after the compile time filter: the runtime filter, then the sink's own level if one is given */
+inline bool enabled(Severity sev) { return runtime_enabled(sev); }
+template <typename S> inline bool enabled(Severity sev, const S &sink) { return runtime_enabled(sev) && sink_enabled(sink, sev); }
+/** enables an overload with return type R only when S is a sink of either kind */
+template <typename S, typename R> struct if_sink : std::enable_if<is_sink<S>::value, R>
+{
+};
+} // namespace detail
+
+/** A snapshot of the logger's own counters. All zero unless SLOG_METRICS is 1 */
+struct Metrics
+{
+    /** log2 buckets of record() latency: bucket i counts calls taking [2^i, 2^(i+1)) ns */
+    static const unsigned BUCKETS = 40;
+    unsigned long long records[4];
+    unsigned long long bytes; /**< the messages, fields and tags logged, as detail::record_bytes estimates them */
+    unsigned long long dropped;
+    /**
+     * the deepest any one async queue got: each logging thread has its own queue per AsyncSink (and per lane with priority_lanes),
+     * so this is not how many records a sink held in all, which may be several times more
+     */
+    unsigned long long queue_high_water;
+    unsigned long long record_ns[BUCKETS];
+    unsigned long long total() const { return records[0] + records[1] + records[2] + records[3]; }
+    /** an upper bound, in ns, on the p-th quantile (0 to 1) of record() latency */
+    unsigned long long record_ns_quantile(double p) const
+    {
+        unsigned long long count = 0, n = 0;
+        for (unsigned i = 0; i < BUCKETS; i++)
+        {
+            n += record_ns[i];
+        }
+        for (unsigned i = 0; i < BUCKETS; i++)
+        {
+            count += record_ns[i];
+            if (n != 0 && count >= p * n)
+            {
+                return 2ULL << i;
+            }
+        }
+        return 0;
+    }
+    /** the counters accumulated since an earlier snapshot. The high-water mark isn't a counter and is kept as is */
+    Metrics since(const Metrics &earlier) const
+    {
+        Metrics d = *this;
+        for (unsigned i = 0; i < 4; i++)
+        {
+            d.records[i] -= earlier.records[i];
+        }
+        d.bytes -= earlier.bytes;
+        d.dropped -= earlier.dropped;
+        for (unsigned i = 0; i < BUCKETS; i++)
+        {
+            d.record_ns[i] -= earlier.record_ns[i];
+        }
+        return d;
+    }
+};
+namespace detail
+{
+#if SLOG_METRICS == 1
+/** one cache line aligned set of counters. Threads are spread over METRICS_SHARDS of these so they rarely share a line */
+struct alignas(64) MetricsShard
+{
+    std::atomic<unsigned long long> records[4];
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> record_ns[Metrics::BUCKETS];
+};
+static const unsigned METRICS_SHARDS = 16;
+struct MetricsState
+{
+    MetricsShard shards[METRICS_SHARDS];
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> queue_high_water;
+    std::atomic<unsigned> next_shard;
+};
+inline MetricsState &metrics_state()
+{
+    static MetricsState state;
+    return state;
+}
+inline MetricsShard &metrics_shard()
+{
+    static thread_local MetricsShard *shard = &metrics_state().shards[metrics_state().next_shard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS];
+    return *shard;
+}
+inline void count_record(Severity sev, std::size_t bytes, std::chrono::steady_clock::duration took)
+{
+    MetricsShard &shard = metrics_shard();
+    shard.records[static_cast<int>(sev)].fetch_add(1, std::memory_order_relaxed);
+    shard.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    unsigned long long ns = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+    unsigned bucket = 0;
+    while (ns > 1 && bucket + 1 < Metrics::BUCKETS)
+    {
+        ns >>= 1;
+        bucket++;
+    }
+    shard.record_ns[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+#if SLOG_METRICS == 1 || SLOG_SITE_STATS == 1
+/** the size of " key=value" for a field, worked out without formatting it: strings unquoted, doubles as 8 bytes */
+inline std::size_t field_bytes(const Field &f)
+{
+    std::size_t n = 2 + std::strlen(f.key);
+    unsigned long long v = 0;
+    switch (f.type)
+    {
+    case Field::Type::INT:
+        n += f.i < 0;
+        v = f.i < 0 ? 0ULL - static_cast<unsigned long long>(f.i) : static_cast<unsigned long long>(f.i);
+        break;
+    case Field::Type::UINT: v = f.u; break;
+    case Field::Type::DOUBLE: return n + 8;
+    case Field::Type::BOOL: return n + (f.b ? 4 : 5);
+    case Field::Type::STRING: return n + f.str.size;
+    }
+    do
+    {
+        n++;
+        v /= 10;
+    } while (v != 0);
+    return n;
+}
+/**
+ * a record's size as counted by the metrics: the message, then its fields and tags as they'd be appended in logfmt, as a FileSink
+ * line would have them. An estimate where field_bytes is
+ */
+inline std::size_t record_bytes(const Context &ctx, const std::string &msg, const Fields &fields)
+{
+    std::size_t n = msg.size();
+    for (const Field &f : fields)
+    {
+        n += field_bytes(f);
+    }
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+    for (const Field &f : ctx.tags)
+    {
+        n += field_bytes(f);
+    }
+#else
+    (void)ctx;
+#endif
+    return n;
+}
+#endif
+#if SLOG_SITE_STATS == 1
+/** a call site's counters. The key is claimed once with a CAS, after which only the counters change */
+struct SiteSlot
+{
+    std::atomic<unsigned long long> key;
+    std::atomic<bool> ready;
+    const char *file_name;
+    const char *func_name;
+    unsigned int line;
+    std::atomic<unsigned long long> records;
+    std::atomic<unsigned long long> bytes;
+};
+struct SiteTable
+{
+    /** sites that don't find a slot within this many probes are counted in overflow instead, bounding the cost */
+    static const unsigned MAX_PROBES = 16;
+    std::atomic<bool> enabled;
+    std::atomic<unsigned long long> overflow;
+    SiteSlot slots[SLOG_SITE_STATS_SLOTS];
+};
+inline SiteTable &site_table()
+{
+    static SiteTable table;
+    return table;
+}
+inline void count_site(const Context &ctx, std::size_t bytes)
+{
+    SiteTable &table = site_table();
+    if (!table.enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    // call sites are identified by their __FILE__ literal's address and line, so no strings are compared here
+    unsigned long long key = (reinterpret_cast<unsigned long long>(ctx.file_name) * 0x9E3779B97F4A7C15ULL) ^ ctx.line;
+    key += key == 0;
+    unsigned long long hash = key ^ (key >> 29);
+    for (unsigned probe = 0; probe < SiteTable::MAX_PROBES; probe++)
+    {
+        SiteSlot &slot = table.slots[(hash + probe) & (SLOG_SITE_STATS_SLOTS - 1)];
+        unsigned long long seen = slot.key.load(std::memory_order_acquire);
+        if (seen == 0 && slot.key.compare_exchange_strong(seen, key, std::memory_order_acq_rel))
+        {
+            slot.file_name = ctx.file_name;
+            slot.func_name = ctx.func_name;
+            slot.line = ctx.line;
+            slot.ready.store(true, std::memory_order_release);
+            seen = key;
+        }
+        if (seen == key)
+        {
+            slot.records.fetch_add(1, std::memory_order_relaxed);
+            slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+            return;
+        }
+    }
+    table.overflow.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+#if SLOG_METRICS == 1 || SLOG_SITE_STATS == 1
+/** whether a record's size is needed: always with SLOG_METRICS, otherwise only while site stats are on */
+inline bool counting_bytes()
+{
+#if SLOG_METRICS == 1
+    return true;
+#else
+    return site_table().enabled.load(std::memory_order_relaxed);
+#endif
+}
+#endif
+/** hands a record to a sink, counting it when SLOG_METRICS or site stats are on. Its size is worked out once for both */
+template <typename S> inline void dispatch(S &sink, Severity sev, const Context &ctx, const std::string &msg)
+{
+    if (!sink_enabled(sink, sev))
+    {
+        return;
+    }
+#if SLOG_METRICS == 1 || SLOG_SITE_STATS == 1
+    std::size_t bytes = counting_bytes() ? record_bytes(ctx, msg, Fields()) : 0;
+#endif
+#if SLOG_METRICS == 1
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sink.record(sev, ctx, msg);
+    count_record(sev, bytes, std::chrono::steady_clock::now() - start);
+#else
+    sink.record(sev, ctx, msg);
+#endif
+#if SLOG_SITE_STATS == 1
+    count_site(ctx, bytes);
+#endif
+}
+template <typename S> inline void dispatch(S &sink, Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+{
+    if (!sink_enabled(sink, sev))
+    {
+        return;
+    }
+#if SLOG_METRICS == 1 || SLOG_SITE_STATS == 1
+    std::size_t bytes = counting_bytes() ? record_bytes(ctx, msg, fields) : 0;
+#endif
+#if SLOG_METRICS == 1
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sink.record_fields(sev, ctx, msg, fields);
+    count_record(sev, bytes, std::chrono::steady_clock::now() - start);
+#else
+    sink.record_fields(sev, ctx, msg, fields);
+#endif
+#if SLOG_SITE_STATS == 1
+    count_site(ctx, bytes);
+#endif
+}
+} // namespace detail
+/** counts records a sink had to throw away, e.g. because its queue was full */
+inline void metrics_note_dropped(unsigned long long n)
+{
+#if SLOG_METRICS == 1
+    detail::metrics_state().dropped.fetch_add(n, std::memory_order_relaxed);
+#else
+    (void)n;
+#endif
+}
+/** raises the queue high-water mark to depth if it's below it. AsyncSink reports each thread's queue on its own */
+inline void metrics_note_queue_depth(unsigned long long depth)
+{
+#if SLOG_METRICS == 1
+    std::atomic<unsigned long long> &hw = detail::metrics_state().queue_high_water;
+    unsigned long long seen = hw.load(std::memory_order_relaxed);
+    while (depth > seen && !hw.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+    {
+    }
+#else
+    (void)depth;
+#endif
+}
+/** sums the per-thread counters into a snapshot */
+inline Metrics metrics_snapshot()
+{
+    Metrics m = Metrics();
+#if SLOG_METRICS == 1
+    detail::MetricsState &state = detail::metrics_state();
+    for (const detail::MetricsShard &shard : state.shards)
+    {
+        for (unsigned i = 0; i < 4; i++)
+        {
+            m.records[i] += shard.records[i].load(std::memory_order_relaxed);
+        }
+        m.bytes += shard.bytes.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < Metrics::BUCKETS; i++)
+        {
+            m.record_ns[i] += shard.record_ns[i].load(std::memory_order_relaxed);
+        }
+    }
+    m.dropped = state.dropped.load(std::memory_order_relaxed);
+    m.queue_high_water = state.queue_high_water.load(std::memory_order_relaxed);
+#endif
+    return m;
+}
+
+#if SLOG_SITE_STATS == 1
+/** What one call site has logged since site stats were last reset */
+struct SiteStats
+{
+    const char *file_name;
+    unsigned int line;
+    const char *func_name;
+    unsigned long long records;
+    unsigned long long bytes; /**< the messages, fields and tags logged, as detail::record_bytes estimates them */
+};
+/** starts or stops counting records and bytes per call site. Off by default; costs one relaxed load per record while off */
+inline void site_stats_enable(bool on) { detail::site_table().enabled.store(on, std::memory_order_relaxed); }
+/** zeroes every call site's counters */
+inline void site_stats_reset()
+{
+    detail::SiteTable &table = detail::site_table();
+    for (detail::SiteSlot &slot : table.slots)
+    {
+        slot.records.store(0, std::memory_order_relaxed);
+        slot.bytes.store(0, std::memory_order_relaxed);
+    }
+    table.overflow.store(0, std::memory_order_relaxed);
+}
+/** records from call sites that didn't fit in the table, and so aren't attributed to any site */
+inline unsigned long long site_stats_overflow() { return detail::site_table().overflow.load(std::memory_order_relaxed); }
+/** the n call sites that logged the most bytes (or records, if by_bytes is false), busiest first */
+inline std::vector<SiteStats> top_sites(std::size_t n, bool by_bytes = true)
+{
+    std::vector<SiteStats> sites;
+    for (const detail::SiteSlot &slot : detail::site_table().slots)
+    {
+        if (!slot.ready.load(std::memory_order_acquire))
+        {
+            continue;
+        }
+        SiteStats stats{slot.file_name, slot.line, slot.func_name, slot.records.load(std::memory_order_relaxed),
+                        slot.bytes.load(std::memory_order_relaxed)};
+        if (stats.records == 0)
+        {
+            continue;
+        }
+        // the same __FILE__ can have a different address in each translation unit, so merge by name here
+        bool merged = false;
+        for (SiteStats &other : sites)
+        {
+            if (other.line == stats.line && std::strcmp(other.file_name, stats.file_name) == 0)
+            {
+                other.records += stats.records;
+                other.bytes += stats.bytes;
+                merged = true;
+                break;
+            }
+        }
+        if (!merged)
+        {
+            sites.push_back(stats);
+        }
+    }
+    std::sort(sites.begin(), sites.end(), [by_bytes](const SiteStats &a, const SiteStats &b) {
+        return by_bytes ? a.bytes > b.bytes : a.records > b.records;
+    });
+    if (sites.size() > n)
+    {
+        sites.resize(n);
+    }
+    return sites;
+}
+#endif
+
+/**
+ * Tags every record the calling thread makes while it's in scope, e.g. slog::ScopedTag tag("req", id). Tags nest, and sinks see them as
+ * Context::tags. The key is borrowed like a Field key, the value is copied into a pooled frame so making one doesn't allocate
+ */
+class ScopedTag
+{
+private:
+    detail::TagFrame *frame;
+public:
+    template <typename T> ScopedTag(const char *key, const T &value) : frame(detail::push_tag(detail::make_field(key, value))) {};
+    ScopedTag(const ScopedTag &) = delete;
+    ScopedTag &operator=(const ScopedTag &) = delete;
+    ~ScopedTag() { detail::pop_tag(frame); }
+};
+
+/** A temporary object that exposes a stream for logging. The stream writes into a reused per-thread buffer */
+template <typename S> class BasicLogObjStream
+{
+private:
+    const Context ctx;
+    const Severity sev;
+    S &sink;
+    detail::ScratchLease msg;
+    SLOG_OUTLINED void finish() { detail::dispatch(sink, sev, ctx, msg->str); }
+public:
+    BasicLogObjStream(Context &&ctx, Severity sev, S &sink) : ctx(ctx), sev(sev), sink(sink) {};
+    BasicLogObjStream(BasicLogObjStream &&) = default;
+    template <typename T> BasicLogObjStream &operator<<(const T &t)
+    {
+        msg->os << t;
+        return *this;
+    }
+    ~BasicLogObjStream()
+    {
+        if (msg.get() != nullptr)
+        {
+            finish();
+        }
+    }
+};
+typedef BasicLogObjStream<Sink> LogObjStream;
+
+namespace detail
+{
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+/** a strftime spec split around the %f (microseconds) extension */
+struct TimeSpec
+{
+    std::string pre;
+    std::string post;
+    bool frac;
+    unsigned long long id;
+    TimeSpec(const std::string &spec = std::string())
+    {
+        static std::atomic<unsigned long long> next_id{1};
+        id = next_id.fetch_add(1, std::memory_order_relaxed);
+        std::string::size_type pos = spec.find("%f");
+        frac = pos != std::string::npos;
+        pre = spec.substr(0, pos);
+        post = frac ? spec.substr(pos + 2) : std::string();
+    }
+};
+/** appends the time formatted by spec. strftime only runs when the second changes */
+inline void append_time(std::string &out, const TimeSpec &spec, std::chrono::time_point<std::chrono::system_clock> time)
+{
+    struct Cache
+    {
+        unsigned long long spec_id;
+        long long sec;
+        std::string pre;
+        std::string post;
+    };
+    static thread_local Cache cache{0, 0, std::string(), std::string()};
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    long long sec = us / 1000000 - (us % 1000000 < 0 ? 1 : 0);
+    if (cache.spec_id != spec.id || cache.sec != sec)
+    {
+        char buf[64];
+        std::time_t t = static_cast<std::time_t>(sec);
+        std::tm tm_buf;
+        ::localtime_r(&t, &tm_buf);
+        cache.pre.assign(buf, std::strftime(buf, sizeof(buf), spec.pre.c_str(), &tm_buf));
+        cache.post.assign(buf, std::strftime(buf, sizeof(buf), spec.post.c_str(), &tm_buf));
+        cache.spec_id = spec.id;
+        cache.sec = sec;
+    }
+    out += cache.pre;
+    if (spec.frac)
+    {
+        append_uint(out, static_cast<unsigned long long>(us - sec * 1000000), 6);
+    }
+    out += cache.post;
+}
+#endif
+} // namespace detail
+
+/**
+ * A log line layout, parsed once into a flat list of ops so rendering a record is a single pass with no format parsing.
+ * Fields are written as {name}: {time} (or {time:<strftime spec>}, where %f is microseconds), {sev}, {tid}, {file},
+ * {line}, {func}, {msg}, {seq} (the per thread record number) and {tags} (the ScopedTags as " key=value" pairs, or nothing).
+ * {{ and }} are literal braces, and unknown fields are copied through as text.
+ */
+class Pattern
+{
+private:
+    enum class OpKind
+    {
+        TEXT,
+        TIME,
+        SEV,
+        TID,
+        FILE,
+        LINE,
+        FUNC,
+        MSG,
+        TAGS,
+        SEQ
+    };
+    struct Op
+    {
+        OpKind kind;
+        std::string text;
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+        detail::TimeSpec time;
+#endif
+        Op(OpKind kind, const std::string &text) : kind(kind), text(text) {};
+    };
+    std::vector<Op> ops;
+    void add_text(const std::string &text)
+    {
+        if (!ops.empty() && ops.back().kind == OpKind::TEXT)
+        {
+            ops.back().text += text;
+        }
+        else
+        {
+            ops.push_back(Op(OpKind::TEXT, text));
+        }
+    }
+    void add_field(const std::string &name, const std::string &arg)
+    {
+        static const struct
+        {
+            const char *name;
+            OpKind kind;
+        } fields[] = {{"time", OpKind::TIME}, {"sev", OpKind::SEV},   {"tid", OpKind::TID}, {"file", OpKind::FILE},
+                      {"line", OpKind::LINE}, {"func", OpKind::FUNC}, {"msg", OpKind::MSG},
+                      {"tags", OpKind::TAGS}, {"seq", OpKind::SEQ}};
+        for (const auto &f : fields)
+        {
+            if (name == f.name)
+            {
+                ops.push_back(Op(f.kind, std::string()));
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+                if (f.kind == OpKind::TIME)
+                {
+                    ops.back().time = detail::TimeSpec(arg.empty() ? "%Y-%m-%dT%H:%M:%S" : arg);
+                }
+#endif
+                return;
+            }
+        }
+        add_text("{" + name + (arg.empty() ? "" : ":" + arg) + "}");
+    }
+public:
+    Pattern(const char *pattern = SLOG_FILE_SINK_PATTERN)
+    {
+        std::string p(pattern);
+        std::string::size_type i = 0;
+        while (i < p.size())
+        {
+            std::string::size_type brace = p.find_first_of("{}", i);
+            if (brace == std::string::npos)
+            {
+                add_text(p.substr(i));
+                break;
+            }
+            add_text(p.substr(i, brace - i));
+            if (brace + 1 < p.size() && p[brace + 1] == p[brace])
+            {
+                add_text(std::string(1, p[brace]));
+                i = brace + 2;
+                continue;
+            }
+            std::string::size_type close = p.find('}', brace + 1);
+            if (p[brace] == '}' || close == std::string::npos)
+            {
+                add_text(p.substr(brace, 1));
+                i = brace + 1;
+                continue;
+            }
+            std::string field = p.substr(brace + 1, close - brace - 1);
+            std::string::size_type colon = field.find(':');
+            add_field(field.substr(0, colon), colon == std::string::npos ? std::string() : field.substr(colon + 1));
+            i = close + 1;
+        }
+    }
+    /** appends the rendered record to out */
+    void render(std::string &out, Severity sev, const Context &ctx, const std::string &msg) const
+    {
+        for (const Op &op : ops)
+        {
+            switch (op.kind)
+            {
+            case OpKind::TEXT: out += op.text; break;
+            case OpKind::SEV: out += severity_to_str(sev); break;
+            case OpKind::MSG: out += msg; break;
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+            case OpKind::TIME: detail::append_time(out, op.time, ctx.time); break;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+            case OpKind::TID: detail::append_uint(out, std::hash<std::thread::id>()(ctx.thread_id)); break;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+            case OpKind::FILE: out += ctx.file_name; break;
+            case OpKind::LINE: detail::append_uint(out, ctx.line); break;
+            case OpKind::FUNC: out += ctx.func_name; break;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+            case OpKind::TAGS: detail::append_tags(out, ctx.tags.innermost()); break;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+            case OpKind::SEQ: detail::append_uint(out, ctx.seq); break;
+#endif
+            default: break;
+            }
+        }
+    }
+};
+
+/**
+ * Compile time counterparts of the Pattern fields, for use with StaticPattern.
+ * Each op is a type with a static append() so the whole layout inlines into one function.
+ */
+namespace pattern
+{
+/** literal characters */
+template <char... C> struct Lit
+{
+    static void append(std::string &out, Severity, const Context &, const std::string &)
+    {
+        static const char text[] = {C...};
+        out.append(text, sizeof...(C));
+    }
+};
+struct Sev
+{
+    static void append(std::string &out, Severity sev, const Context &, const std::string &) { out += severity_to_str(sev); }
+};
+struct Msg
+{
+    static void append(std::string &out, Severity, const Context &, const std::string &msg) { out += msg; }
+};
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+/** the default time spec, matching {time} */
+struct IsoSeconds
+{
+    static const char *spec() { return "%Y-%m-%dT%H:%M:%S"; }
+};
+/** the record time. Spec is a type with a static spec() returning the strftime spec */
+template <typename Spec = IsoSeconds> struct Time
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &)
+    {
+        static const detail::TimeSpec spec(Spec::spec());
+        detail::append_time(out, spec, ctx.time);
+    }
+};
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+struct Tid
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &)
+    {
+        detail::append_uint(out, std::hash<std::thread::id>()(ctx.thread_id));
+    }
+};
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+struct File
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &) { out += ctx.file_name; }
+};
+struct Line
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &) { detail::append_uint(out, ctx.line); }
+};
+struct Func
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &) { out += ctx.func_name; }
+};
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+/** the ScopedTags as " key=value" pairs, matching {tags} */
+struct Tags
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &) { detail::append_tags(out, ctx.tags.innermost()); }
+};
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+struct Seq
+{
+    static void append(std::string &out, Severity, const Context &ctx, const std::string &) { detail::append_uint(out, ctx.seq); }
+};
+#endif
+} // namespace pattern
+/** A layout fixed at compile time as a list of slog::pattern ops, e.g. StaticPattern<pattern::Sev, pattern::Lit<' '>, pattern::Msg> */
+template <typename... Ops> struct StaticPattern
+{
+    void render(std::string &out, Severity sev, const Context &ctx, const std::string &msg) const
+    {
+        int expand[] = {0, (Ops::append(out, sev, ctx, msg), 0)...};
+        (void)expand;
+    }
+};
+
+#if SLOG_FILE_SINK == 1
+/** An implementation of the sink that writes lines rendered by Layout (Pattern or StaticPattern) to a FILE* */
+template <typename Layout> class BasicFileSink : public Sink
+{
+private:
+    std::FILE *file;
+    bool close_dtor;
+    Layout layout;
+public:
+    BasicFileSink(std::FILE *file = stderr, bool close_dtor = false, Layout layout = Layout())
+        : file(file), close_dtor(close_dtor), layout(std::move(layout)) {};
+    void record(Severity sev, const Context &ctx, const std::string &msg) override
+    {
+        static thread_local std::string line;
+        line.clear();
+        layout.render(line, sev, ctx, msg);
+        line += '\n';
+        std::fwrite(line.data(), 1, line.size(), file);
+    }
+    void flush() override { std::fflush(file); }
+    /** switches to another FILE*, closing the old one if it was the sink's to close. Not safe while records are being written */
+    void reopen(std::FILE *to, bool close_to = false)
+    {
+        if (close_dtor)
+        {
+            fclose(file);
+        }
+        file = to;
+        close_dtor = close_to;
+    }
+    ~BasicFileSink()
+    {
+        if (close_dtor)
+        {
+            fclose(file);
+        }
+    }
+};
+/** An implementation of the sink that goes to a FILE*, laid out by a runtime Pattern */
+class FileSink : public BasicFileSink<Pattern>
+{
+public:
+    FileSink(std::FILE *file = stderr, bool close_dtor = false, const char *pattern = SLOG_FILE_SINK_PATTERN)
+        : BasicFileSink<Pattern>(file, close_dtor, Pattern(pattern)) {};
+};
+#endif
+#if SLOG_FILE_SINK_DEFAULT == 1
+inline Sink &DEFAULT_SINK()
+{
+    static FileSink sink;
+    return sink;
+}
+#else
+extern Sink &DEFAULT_SINK();
+#endif
+
+namespace detail
+{
+/** locks lock, giving up at deadline. Returns whether it was locked */
+inline bool lock_until(std::unique_lock<std::mutex> &lock, std::chrono::steady_clock::time_point deadline)
+{
+    while (!lock.try_lock())
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+/**
+ * a sink with a backend thread or other state for slog::shutdown to settle and fork() to carry over, such as TraceSink's pid.
+ * Registered for as long as it's alive
+ */
+class Closeable
+{
+public:
+    /** forwards whatever is queued, then stops the backend. Returns whether that was done by deadline */
+    virtual bool close(std::chrono::steady_clock::time_point deadline) = 0;
+    /** parks the backend and takes every lock, so the child of a fork gets a consistent copy. Gives up on the backend after SLOG_FORK_TIMEOUT_MS */
+    virtual void before_fork() = 0;
+    /** undoes before_fork, in the parent or the child. Called with the registry locked, so it must not make or destroy sinks */
+    virtual void after_fork(bool child) = 0;
+    /** starts the child's backend after a fork, with the registry unlocked */
+    virtual void start_in_child() = 0;
+protected:
+    ~Closeable() = default;
+};
+struct Closeables
+{
+    std::mutex mtx;
+    std::vector<Closeable *> list;
+};
+inline Closeables &closeables()
+{
+    static Closeables c;
+    return c;
+}
+inline bool close_all(std::chrono::steady_clock::time_point deadline)
+{
+    Closeables &c = closeables();
+    std::lock_guard<std::mutex> lock(c.mtx);
+    bool done = true;
+    // sinks are made before the sinks that wrap them, so going newest first drains each into a target that's still running
+    for (std::vector<Closeable *>::reverse_iterator it = c.list.rbegin(); it != c.list.rend(); ++it)
+    {
+        done = (*it)->close(deadline) && done;
+    }
+    return done;
+}
+inline void close_at_exit()
+{
+    // the default sink may already be destroyed by now, but it only writes to stdio, which fflush reaches anyway
+    close_all(std::chrono::steady_clock::now() + std::chrono::milliseconds(SLOG_SHUTDOWN_TIMEOUT_MS));
+    std::fflush(nullptr);
+}
+#if SLOG_ATFORK == 1
+inline void closeables_before_fork()
+{
+    Closeables &c = closeables();
+    // held across the fork, so no sink comes or goes meanwhile
+    c.mtx.lock();
+    // wrappers first, so what they drain lands in a sink that's still running
+    for (std::vector<Closeable *>::reverse_iterator it = c.list.rbegin(); it != c.list.rend(); ++it)
+    {
+        (*it)->before_fork();
+    }
+}
+inline void closeables_after_fork_parent()
+{
+    Closeables &c = closeables();
+    for (Closeable *closeable : c.list)
+    {
+        closeable->after_fork(false);
+    }
+    c.mtx.unlock();
+}
+inline void closeables_after_fork_child()
+{
+    Closeables &c = closeables();
+    for (Closeable *closeable : c.list)
+    {
+        closeable->after_fork(true);
+    }
+    std::vector<Closeable *> started = c.list;
+    c.mtx.unlock();
+    // unlocked, since on_fork_child may make or destroy sinks. One it destroys is skipped; one it makes already has its backend
+    for (Closeable *closeable : started)
+    {
+        std::unique_lock<std::mutex> lock(c.mtx);
+        if (std::find(c.list.begin(), c.list.end(), closeable) == c.list.end())
+        {
+            continue;
+        }
+        lock.unlock();
+        closeable->start_in_child();
+    }
+}
+#endif
+inline void add_closeable(Closeable *closeable)
+{
+    Closeables &c = closeables();
+    std::lock_guard<std::mutex> lock(c.mtx);
+    c.list.push_back(closeable);
+#if SLOG_SHUTDOWN_AT_EXIT == 1
+    static bool at_exit = std::atexit(close_at_exit) == 0;
+    (void)at_exit;
+#endif
+#if SLOG_ATFORK == 1
+    static bool at_fork = pthread_atfork(closeables_before_fork, closeables_after_fork_parent, closeables_after_fork_child) == 0;
+    (void)at_fork;
+#endif
+}
+inline void remove_closeable(Closeable *closeable)
+{
+    Closeables &c = closeables();
+    std::lock_guard<std::mutex> lock(c.mtx);
+    c.list.erase(std::remove(c.list.begin(), c.list.end(), closeable), c.list.end());
+}
+} // namespace detail
+
+/**
+ * closes every live AsyncSink, TraceSink and MetricsReporter: async sinks forward what they have queued and flush their target, then
+ * their backend threads stop. Then flushes the default sink and every stdio stream. No other sink is flushed, so a sink logged to
+ * directly must be flushed by its owner. Sinks still busy at deadline are left behind. Returns whether everything was done in time.
+ * Records logged to an AsyncSink afterwards are forwarded by the thread logging them. With SLOG_SHUTDOWN_AT_EXIT this runs at exit
+ */
+inline bool shutdown(std::chrono::steady_clock::time_point deadline)
+{
+    bool done = detail::close_all(deadline);
+    DEFAULT_SINK().flush();
+    std::fflush(nullptr);
+    return done;
+}
+template <typename Rep, typename Period> inline bool shutdown(std::chrono::duration<Rep, Period> timeout)
+{
+    return shutdown(std::chrono::steady_clock::now() + timeout);
+}
+
+/*
+ * The log_impl overloads are what the SLOG macros call once a record is enabled. They take the call site rather than a Context
+ * so that making the Context, leasing a buffer and dispatching all happen here, out of line, instead of at every call site
+ */
+SLOG_OUTLINED inline LogObjStream log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev)
+{
+    return LogObjStream(make_ctx(file_name, line, func_name), sev, DEFAULT_SINK());
+};
+template <typename S>
+SLOG_OUTLINED inline typename detail::if_sink<S, BasicLogObjStream<typename detail::sink_target<S>::type>>::type
+log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev, S &sink)
+{
+    return BasicLogObjStream<typename detail::sink_target<S>::type>(make_ctx(file_name, line, func_name), sev, sink);
+};
+
+SLOG_OUTLINED inline void log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev, const std::string &msg)
+{
+    detail::dispatch(DEFAULT_SINK(), sev, make_ctx(file_name, line, func_name), msg);
+};
+template <typename S>
+SLOG_OUTLINED inline typename detail::if_sink<S, void>::type log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev,
+                                                                      S &sink, const std::string &msg)
+{
+    detail::dispatch(sink, sev, make_ctx(file_name, line, func_name), msg);
+};
+// C strings are copied into a per-thread buffer instead of a temporary std::string
+SLOG_OUTLINED inline void log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *msg)
+{
+    detail::ScratchLease lease;
+    detail::dispatch(DEFAULT_SINK(), sev, make_ctx(file_name, line, func_name), detail::as_msg(msg, lease));
+};
+template <typename S>
+SLOG_OUTLINED inline typename detail::if_sink<S, void>::type log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev,
+                                                                      S &sink, const char *msg)
+{
+    detail::ScratchLease lease;
+    detail::dispatch(sink, sev, make_ctx(file_name, line, func_name), detail::as_msg(msg, lease));
+};
+
+template <typename S, typename M, typename... KV>
+SLOG_OUTLINED inline typename detail::if_sink<S, void>::type log_kv_impl(const char *file_name, unsigned int line, const char *func_name,
+                                                                         Severity sev, S &sink, const M &msg, const KV &...kv)
+{
+    static_assert(sizeof...(KV) % 2 == 0, "SLOG_KV takes a message followed by key, value pairs");
+    Field fields[sizeof...(KV) / 2 + 1];
+    detail::fill_fields(fields, kv...);
+    detail::ScratchLease lease;
+    detail::dispatch(sink, sev, make_ctx(file_name, line, func_name), detail::as_msg(msg, lease), Fields(fields, sizeof...(KV) / 2));
+}
+template <typename M, typename... KV>
+inline typename std::enable_if<!detail::is_sink<M>::value>::type log_kv_impl(const char *file_name, unsigned int line, const char *func_name,
+                                                                             Severity sev, const M &msg, const KV &...kv)
+{
+    log_kv_impl(file_name, line, func_name, sev, DEFAULT_SINK(), msg, kv...);
+}
+
+/** Logs how long the rest of its scope took when it's destroyed. Made by SLOG_TIMED */
+template <typename S> class TimedScope
+{
+private:
+    S *sink; /**< null when the severity is filtered out, in which case nothing is timed */
+    const char *file_name;
+    unsigned int line;
+    const char *func_name;
+    Severity sev;
+    const char *name;
+    std::chrono::steady_clock::duration threshold;
+    std::chrono::steady_clock::time_point start;
+public:
+    TimedScope(S *sink, const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *name,
+               std::chrono::steady_clock::duration threshold)
+        : sink(sink), file_name(file_name), line(line), func_name(func_name), sev(sev), name(name), threshold(threshold)
+    {
+        if (sink != nullptr)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    TimedScope(TimedScope &&other)
+        : sink(other.sink), file_name(other.file_name), line(other.line), func_name(other.func_name), sev(other.sev), name(other.name),
+          threshold(other.threshold), start(other.start)
+    {
+        other.sink = nullptr;
+    }
+    ~TimedScope()
+    {
+        if (sink == nullptr)
+        {
+            return;
+        }
+        std::chrono::steady_clock::duration took = std::chrono::steady_clock::now() - start;
+        if (took < threshold)
+        {
+            return;
+        }
+        log_kv_impl(file_name, line, func_name, sev, *sink, name, "elapsed_us",
+                    std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(took).count());
+    }
+};
+namespace detail
+{
+inline TimedScope<Sink> timed(bool on, const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *name)
+{
+    return TimedScope<Sink>(on ? &DEFAULT_SINK() : nullptr, file_name, line, func_name, sev, name, std::chrono::steady_clock::duration::zero());
+}
+template <typename Rep, typename Period>
+inline TimedScope<Sink> timed(bool on, const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *name,
+                              std::chrono::duration<Rep, Period> threshold)
+{
+    return TimedScope<Sink>(on ? &DEFAULT_SINK() : nullptr, file_name, line, func_name, sev, name,
+                            std::chrono::duration_cast<std::chrono::steady_clock::duration>(threshold));
+}
+template <typename S>
+inline typename if_sink<S, TimedScope<typename sink_target<S>::type>>::type timed(bool on, const char *file_name, unsigned int line,
+                                                                                   const char *func_name, Severity sev, const char *name, S &sink)
+{
+    return TimedScope<typename sink_target<S>::type>(on ? &sink : nullptr, file_name, line, func_name, sev, name,
+                                                     std::chrono::steady_clock::duration::zero());
+}
+template <typename S, typename Rep, typename Period>
+inline typename if_sink<S, TimedScope<typename sink_target<S>::type>>::type timed(bool on, const char *file_name, unsigned int line,
+                                                                                   const char *func_name, Severity sev, const char *name, S &sink,
+                                                                                   std::chrono::duration<Rep, Period> threshold)
+{
+    return TimedScope<typename sink_target<S>::type>(on ? &sink : nullptr, file_name, line, func_name, sev, name,
+                                                     std::chrono::duration_cast<std::chrono::steady_clock::duration>(threshold));
+}
+} // namespace detail
+
+#if SLOG_FMT == 1 || SLOG_FMT == 2
+template <typename... T>
+SLOG_OUTLINED inline void log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev, SLOG_FMT_NS::format_string<T...> fmt,
+                                   T &&...args)
+{
+    detail::ScratchLease lease;
+    SLOG_FMT_NS::format_to(std::back_inserter(lease->str), fmt, std::forward<T>(args)...);
+    detail::dispatch(DEFAULT_SINK(), sev, make_ctx(file_name, line, func_name), lease->str);
+};
+// takes at least one argument so a plain message prefers the string overloads above
+template <typename S, typename A, typename... T>
+SLOG_OUTLINED inline typename detail::if_sink<S, void>::type log_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev,
+                                                                      S &sink, SLOG_FMT_NS::format_string<A, T...> fmt, A &&arg, T &&...args)
+{
+    detail::ScratchLease lease;
+    SLOG_FMT_NS::format_to(std::back_inserter(lease->str), fmt, std::forward<A>(arg), std::forward<T>(args)...);
+    detail::dispatch(sink, sev, make_ctx(file_name, line, func_name), lease->str);
+};
+#endif
+} // namespace slog
+// clang-format off
+/** true when SEV is filtered out at compile time (SLOG_STRIP_BELOW) or at runtime (slog::set_min_severity) */
+#define SLOG_FILTERED_(SEV) ((slog::Severity::SEV < slog::Severity::SLOG_STRIP_BELOW) || !slog::detail::runtime_enabled(slog::Severity::SEV))
+/*
+ * The enabled check is the only thing expanded at the call site, as one branch marked unlikely to be taken. Everything else is a
+ * single call into the out of line log_impl, so a disabled or rarely taken SLOG costs the hot path a compare and a jump.
+ * When SEV is filtered out, at compile time or at runtime, none of the arguments are evaluated: not COND, not the message or format
+ * arguments, and not anything streamed in with <<. COND itself is only evaluated once SEV has passed both filters
+ */
+#define SLOG_IF(SEV, COND, ...) if(SLOG_LIKELY(SLOG_FILTERED_(SEV) || !(COND))){;} else SLOG_COLD_BRANCH \
+    slog::log_impl(__FILE__, __LINE__, __FUNCTION__, slog::Severity::SEV, ##__VA_ARGS__)
+#define SLOG(SEV, ...) SLOG_IF(SEV, true, ##__VA_ARGS__)
+/**
+ * true when a SLOG at SEV would be logged, to guard expensive preparation: if (SLOG_ENABLED(DEBUG)) { ... }. Costs the same as SLOG's own
+ * filter. Given a sink, that sink's own minimum severity (Sink::set_min_severity) is checked as well
+ */
+#define SLOG_ENABLED(SEV, ...) (!(slog::Severity::SEV < slog::Severity::SLOG_STRIP_BELOW) && slog::detail::enabled(slog::Severity::SEV, ##__VA_ARGS__))
+/** logs a message with typed key, value fields, e.g. SLOG_KV(INFO, "done", "latency_us", lat) or SLOG_KV(INFO, sink, "done", ...) */
+#define SLOG_KV(SEV, ...) if(SLOG_LIKELY(SLOG_FILTERED_(SEV))){;} else SLOG_COLD_BRANCH \
+    slog::log_kv_impl(__FILE__, __LINE__, __FUNCTION__, slog::Severity::SEV, __VA_ARGS__)
+#define SLOG_CONCAT_(A, B) A##B
+#define SLOG_CONCAT(A, B) SLOG_CONCAT_(A, B)
+/**
+ * times the rest of the enclosing scope and logs NAME with an elapsed_us field when it exits, e.g. SLOG_TIMED(INFO, "load"),
+ * optionally followed by a sink and/or a std::chrono duration below which nothing is logged. Filtered out severities never read the clock
+ */
+#define SLOG_TIMED(SEV, NAME, ...) auto SLOG_CONCAT(slog_timed_, __LINE__) = slog::detail::timed( \
+    !SLOG_FILTERED_(SEV), __FILE__, __LINE__, __FUNCTION__, slog::Severity::SEV, NAME, ##__VA_ARGS__)
 // clang-format on
 #endif
\ No newline at end of file
@@ -0,0 +1,1826 @@
+/**
+ * @file slog_async.hpp
+ * @author saltyJeff (saltyJeff@users.noreply.github.com)
+ * @brief saltyLogger: sinks that fan out and hand records off to backend threads
+ * @license MIT
+ */
+#pragma once
+#ifndef SLOG_ASYNC_HPP_
+#define SLOG_ASYNC_HPP_
+#include "slog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef SLOG_FUTEX
+#ifdef __linux__
+/** whether idle backend threads sleep on a futex (1) or a condition variable (0). Defaults to 1 on Linux */
+#define SLOG_FUTEX 1
+#else
+#define SLOG_FUTEX 0
+#endif
+#endif
+#ifndef SLOG_ASYNC_SLOT
+/** the size in bytes of the slots AsyncSink queues records in, 64 or 128. A record takes as many consecutive slots as it needs */
+#define SLOG_ASYNC_SLOT 64
+#endif
+#ifndef SLOG_ASYNC_SINKS
+/** how many AsyncSinks can be alive at once and still be reached by AsyncSink::visit_all_queued, e.g. from a crash handler */
+#define SLOG_ASYNC_SINKS 64
+#endif
+#ifndef SLOG_ASYNC_RING
+/** how many slots each thread's ring in an AsyncSink starts with. A ring that fills up is followed by one twice the size */
+#define SLOG_ASYNC_RING 1024
+#endif
+#if SLOG_FUTEX == 1
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace slog
+{
+namespace detail
+{
+/** allocates bytes aligned to SLOG_ASYNC_SLOT */
+inline void *alloc_aligned(std::size_t bytes)
+{
+    unsigned char *raw = static_cast<unsigned char *>(::operator new(bytes + SLOG_ASYNC_SLOT));
+    unsigned char *aligned = raw + SLOG_ASYNC_SLOT - reinterpret_cast<std::uintptr_t>(raw) % SLOG_ASYNC_SLOT;
+    // the offset back to the allocation goes in the byte before
+    aligned[-1] = static_cast<unsigned char>(aligned - raw);
+    return aligned;
+}
+inline void free_aligned(void *p)
+{
+    unsigned char *aligned = static_cast<unsigned char *>(p);
+    ::operator delete(aligned - aligned[-1]);
+}
+/** the huge page size slot memory is rounded up to when it's mapped on huge pages */
+constexpr std::size_t huge_page = std::size_t(2) << 20;
+/** the NUMA node the calling thread is running on, or -1 if that's unknown */
+inline int current_node()
+{
+#ifdef __linux__
+    unsigned int cpu = 0, node = 0;
+    return syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? static_cast<int>(node) : -1;
+#else
+    return -1;
+#endif
+}
+/** the CPUs of a NUMA node, empty if that's unknown */
+inline std::vector<int> node_cpus(int node)
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    std::FILE *list = std::fopen(path, "r");
+    if (list == nullptr)
+    {
+        return cpus;
+    }
+    // e.g. "0-3,8-11"
+    int first, last;
+    while (std::fscanf(list, "%d", &first) == 1)
+    {
+        last = first;
+        int sep = std::fgetc(list);
+        if (sep == '-' && std::fscanf(list, "%d", &last) == 1)
+        {
+            sep = std::fgetc(list);
+        }
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+        if (sep != ',')
+        {
+            break;
+        }
+    }
+    std::fclose(list);
+#else
+    (void)node;
+#endif
+    return cpus;
+}
+/**
+ * maps bytes of memory for slots, preferring NUMA node node (-1 for any). With huge, the memory is on explicit huge pages if the
+ * system has any reserved and bytes is rounded up to a whole number of them, otherwise transparent huge pages are asked for.
+ * Whatever isn't available is done without
+ */
+inline void *map_slots(std::size_t &bytes, bool huge, int node)
+{
+#ifdef __linux__
+    void *p = MAP_FAILED;
+    if (huge)
+    {
+        std::size_t rounded = (bytes + huge_page - 1) & ~(huge_page - 1);
+        p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        bytes = p != MAP_FAILED ? rounded : bytes;
+    }
+    if (p == MAP_FAILED)
+    {
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        if (huge)
+        {
+            madvise(p, bytes, MADV_HUGEPAGE);
+        }
+    }
+    if (node >= 0 && node < 64)
+    {
+        // MPOL_PREFERRED, from numaif.h, which isn't always installed. The pages aren't touched yet, so they're all placed by it
+        const int preferred = 1;
+        unsigned long mask = 1UL << node;
+        syscall(SYS_mbind, p, bytes, preferred, &mask, sizeof(mask) * 8 + 1, 0);
+    }
+    return p;
+#else
+    (void)huge;
+    (void)node;
+    return alloc_aligned(bytes);
+#endif
+}
+inline void unmap_slots(void *p, std::size_t bytes)
+{
+#ifdef __linux__
+    munmap(p, bytes);
+#else
+    (void)bytes;
+    free_aligned(p);
+#endif
+}
+/** tells the CPU we're spinning, so it can give the sibling hyperthread the core */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+/**
+ * Puts one consumer thread to sleep until a producer has work for it. Producers only pay for a load unless the consumer is actually
+ * asleep, in which case one of them makes the wake syscall
+ */
+class Parker
+{
+private:
+    static constexpr int RUNNING = 0;
+    static constexpr int PARKED = 1;
+    std::atomic<int> state{RUNNING};
+#if SLOG_FUTEX == 1
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "futexes need a plain int");
+    int *word() { return reinterpret_cast<int *>(&state); }
+#else
+    std::mutex mtx;
+    std::condition_variable cv;
+#endif
+public:
+    /** announces the consumer is about to sleep. It must look for work once more afterwards, then cancel() or park() */
+    void prepare() { state.store(PARKED); }
+    void cancel() { state.store(RUNNING); }
+    /** sleeps until unpark() or the deadline, returning at once if unpark() came since prepare() */
+    void park(std::chrono::steady_clock::time_point deadline)
+    {
+#if SLOG_FUTEX == 1
+        while (state.load() == PARKED)
+        {
+            timespec ts;
+            timespec *timeout = nullptr;
+            if (deadline != std::chrono::steady_clock::time_point::max())
+            {
+                std::chrono::nanoseconds left = deadline - std::chrono::steady_clock::now();
+                if (left.count() <= 0)
+                {
+                    break;
+                }
+                ts.tv_sec = static_cast<time_t>(left.count() / 1000000000);
+                ts.tv_nsec = static_cast<long>(left.count() % 1000000000);
+                timeout = &ts;
+            }
+            syscall(SYS_futex, word(), FUTEX_WAIT_PRIVATE, PARKED, timeout, nullptr, 0);
+        }
+#else
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_until(lock, deadline, [this] { return state.load() != PARKED; });
+#endif
+        state.store(RUNNING);
+    }
+    /** wakes the consumer if it's parked */
+    void unpark()
+    {
+        if (state.load() != PARKED || state.exchange(RUNNING) != PARKED)
+        {
+            return;
+        }
+#if SLOG_FUTEX == 1
+        syscall(SYS_futex, word(), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        std::lock_guard<std::mutex> lock(mtx);
+        cv.notify_one();
+#endif
+    }
+};
+/**
+ * Counts the changes made to what it guards, and is odd while one is under way, so a reader that can't take the writers' lock (a
+ * signal handler) can tell whether what it read was being changed. Writers must already exclude each other
+ */
+class Version
+{
+private:
+    std::atomic<unsigned int> count{0};
+    void bump(std::memory_order order) { count.store(count.load(std::memory_order_relaxed) + 1, order); }
+public:
+    /** marks a change under way for as long as it's alive */
+    class Change
+    {
+    private:
+        Version &v;
+    public:
+        explicit Change(Version &v) : v(v)
+        {
+            v.bump(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        Change(const Change &) = delete;
+        Change &operator=(const Change &) = delete;
+        ~Change() { v.bump(std::memory_order_release); }
+    };
+    /** the version to check reads against, which is odd if a change is under way */
+    unsigned int read() const { return count.load(std::memory_order_acquire); }
+    /** whether nothing changed since read() returned seen, so what was read in between is what was there */
+    bool still(unsigned int seen) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return count.load(std::memory_order_relaxed) == seen;
+    }
+};
+} // namespace detail
+
+/** what an AsyncSink does with a record that arrives while its queue is full */
+enum class Overflow
+{
+    BLOCK,       /**< waits up to AsyncOptions::block_timeout for room, then drops the record */
+    DROP_NEWEST, /**< drops the record */
+    DROP_OLDEST, /**< drops the oldest record the backend hasn't picked up yet to make room, or the new one if there's none */
+    DROP_BELOW,  /**< drops the record if it's below AsyncOptions::drop_below, otherwise queues it past the capacity. ERROR is never dropped */
+};
+/** settings for an AsyncSink. The defaults give an unbounded queue */
+struct AsyncOptions
+{
+    /** how many records each producer thread can have waiting (in each lane, with priority_lanes), 0 for no limit */
+    std::size_t capacity = 0;
+    /**
+     * queues each severity separately and always forwards the most severe waiting records first, so an ERROR doesn't wait behind a
+     * backlog of DEBUG. Records then reach the target out of order across severities; Context::seq restores each thread's order
+     */
+    bool priority_lanes = false;
+    Overflow overflow = Overflow::BLOCK;
+    std::chrono::milliseconds block_timeout{100};
+    Severity drop_below = Severity::WARN;
+    /** how often at most the "N records dropped" record is sent to the target, once there's room again */
+    std::chrono::milliseconds drop_report_period{1000};
+    /**
+     * how long the backend holds records back so that ones with an earlier Context::time, logged by other threads, can be merged in
+     * ahead of them. Longer windows order more of the output at the cost of latency; 0 merges whatever has arrived without waiting.
+     * No record is held longer than the window by the steady clock, even if the wall clock steps back meanwhile. Without SLOG_CTX_TIME
+     * records are merged in the order they arrived and this is ignored
+     */
+    std::chrono::microseconds reorder_window{0};
+    /**
+     * once it runs out of records, the backend polls for this long, then yields its core between polls for idle_yield more, and only
+     * then goes to sleep. Records arriving before it sleeps are picked up without a syscall on either side. Both are skipped on
+     * single core machines, where they'd only hold up the producers
+     */
+    std::chrono::microseconds idle_spin{50};
+    std::chrono::microseconds idle_yield{500};
+    /** runs the backend on a thread of its own. Otherwise there's none, and the records go when run() or poll() is called */
+    bool own_thread = true;
+    /** the CPUs the backend thread may run on, empty for any. This and the other placement settings are only applied on Linux */
+    std::vector<int> cpus;
+    /** the backend thread's scheduling policy (SCHED_FIFO, SCHED_RR, SCHED_BATCH, SCHED_IDLE...) and priority, or -1 to inherit them */
+    int sched_policy = -1;
+    int sched_priority = 0;
+    /** added to the backend thread's nice value */
+    int nice = 0;
+    /** the backend thread's name as shown by top and debuggers, at most 15 characters */
+    std::string thread_name = "slog_async";
+    /**
+     * maps the rings records are queued in on huge pages: explicit ones (MAP_HUGETLB) if the system has some reserved, otherwise
+     * transparent ones. Each thread's rings then start at one huge page (2MB) rather than SLOG_ASYNC_RING slots
+     */
+    bool huge_pages = false;
+    /**
+     * the NUMA node to put the rings and the backend thread on (unless cpus is set), so that with one sink per node, each logged to by
+     * that node's threads, nothing on the logging path crosses sockets. -1 (the default) puts each thread's rings on the node it ran
+     * on when they were made, and leaves the backend thread where it is. Only applied on Linux, and skipped where it can't be
+     */
+    int node = -1;
+    /**
+     * called in the child of a fork() before its backend starts, with the forking thread the only one left, e.g. to reopen the
+     * target's file under a name of the child's own (see BasicFileSink::reopen). slog's locks are released by then, so it may make
+     * and destroy sinks
+     */
+    std::function<void()> on_fork_child;
+};
+
+namespace detail
+{
+/**
+ * Everything an AsyncSink and its backend work on. The backend thread holds a reference of its own, so that one slog::shutdown left
+ * stuck in the target can outlive the sink without touching freed memory
+ */
+class AsyncCore : public std::enable_shared_from_this<AsyncCore>
+{
+private:
+    /** a record is laid out over one or more consecutive slots, so draining a ring reads memory front to back */
+    struct alignas(SLOG_ASYNC_SLOT) Slot
+    {
+        unsigned char bytes[SLOG_ASYNC_SLOT];
+    };
+    /** what every run of slots starts with, small enough that padding fits in the one slot left at the end of a ring */
+    struct Header
+    {
+        std::uint32_t slots; /**< including this one */
+        bool padding : 1;    /**< fills the end of a ring that the next record didn't fit in, and holds no record */
+        bool foreign : 1;    /**< a record made on another thread than the buffer's, whose id follows it */
+        std::uint8_t sev;
+        std::uint16_t nfields;
+    };
+    /**
+     * the start of a record in its first slot, with room to spare there: its Context taken apart, less the thread id it nearly always
+     * shares with the buffer's owner. Its fields, message and the text of its string fields follow
+     */
+    struct Record : Header
+    {
+        std::uint32_t msg_size;
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+        std::uint32_t line;
+        const char *file_name;
+        const char *func_name;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+        std::chrono::time_point<std::chrono::system_clock> time;
+#else
+        unsigned long long arrival; /**< what the merge orders by without SLOG_CTX_TIME */
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+        const detail::TagFrame *tags;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+        unsigned long long seq;
+#endif
+        /** the room a foreign record's thread id takes, keeping the fields after it aligned */
+        static constexpr std::size_t id_size = (sizeof(std::thread::id) + alignof(Field) - 1) / alignof(Field) * alignof(Field);
+        std::thread::id *thread_id() { return reinterpret_cast<std::thread::id *>(this + 1); }
+        Field *fields() { return reinterpret_cast<Field *>(reinterpret_cast<unsigned char *>(this + 1) + (foreign ? id_size : 0)); }
+        char *msg() { return reinterpret_cast<char *>(fields() + nfields); }
+        char *text() { return msg() + msg_size; }
+        static std::size_t slots_for(bool foreign, std::size_t nfields, std::size_t msg_size, std::size_t text_size)
+        {
+            std::size_t bytes = sizeof(Record) + (foreign ? id_size : 0) + nfields * sizeof(Field) + msg_size + text_size;
+            return (bytes + SLOG_ASYNC_SLOT - 1) / SLOG_ASYNC_SLOT;
+        }
+        /** what the merge orders by: Context::time in ns, or the arrival order without SLOG_CTX_TIME */
+        unsigned long long stamp() const
+        {
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+            return nanos(time);
+#else
+            return arrival;
+#endif
+        }
+        /** takes ctx apart. foreign must be set first, as it says whether there's room for the thread id */
+        void store(const Context &ctx)
+        {
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+            line = ctx.line;
+            file_name = ctx.file_name;
+            func_name = ctx.func_name;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+            time = ctx.time;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+            if (foreign)
+            {
+                new (thread_id()) std::thread::id(ctx.thread_id);
+            }
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+            tags = ctx.tags.innermost();
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+            seq = ctx.seq;
+#endif
+        }
+        /** puts the Context back together, given the thread the record's buffer belongs to */
+        Context context(std::thread::id owner)
+        {
+            Context ctx;
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+            ctx.file_name = file_name;
+            ctx.line = line;
+            ctx.func_name = func_name;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+            ctx.time = time;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+            ctx.thread_id = foreign ? *thread_id() : owner;
+#else
+            (void)owner;
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+            ctx.tags = Tags(tags);
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+            ctx.seq = seq;
+#endif
+            return ctx;
+        }
+    };
+    static_assert(sizeof(Record) < SLOG_ASYNC_SLOT, "a record's header must leave room in its first slot");
+    /**
+     * A ring of slots that one producer appends to. Records never wrap around: one that doesn't fit before the end goes at the start,
+     * after a padding record. Indices count slots from when the ring was made. The slots are mapped apart from this, so that a ring
+     * on huge pages fills them exactly
+     */
+    struct Ring
+    {
+        /** slots the backend is done with. On its own cache line, as it's the only thing the backend writes */
+        alignas(SLOG_ASYNC_SLOT) std::atomic<std::size_t> tail{0};
+        /** slots written. This and the rest are only touched under the buffer's mtx */
+        alignas(SLOG_ASYNC_SLOT) std::size_t head = 0;
+        std::size_t oldest = 0;  /**< where the records the backend hasn't claimed start */
+        std::size_t claimed = 0; /**< where the backend's last claim on it ended */
+        std::size_t records = 0; /**< how many of them there are */
+        std::size_t size;        /**< in slots, a power of 2 */
+        Slot *slots;
+        std::size_t bytes;    /**< mapped for slots */
+        Ring *next = nullptr; /**< the ring the producer moved on to when this one filled up */
+        Ring(std::size_t size, Slot *slots, std::size_t bytes) : size(size), slots(slots), bytes(bytes) {}
+        void *slot(std::size_t index) { return slots + (index & (size - 1)); }
+        Header &header(std::size_t index) { return *static_cast<Header *>(slot(index)); }
+        Record &at(std::size_t index) { return *static_cast<Record *>(slot(index)); }
+        /** whether n more slots fit, and how many padding slots they need first */
+        bool fits(std::size_t n, std::size_t &pad) const
+        {
+            std::size_t pos = head & (size - 1);
+            pad = pos + n > size ? size - pos : 0;
+            return n <= size && head + pad + n - tail.load(std::memory_order_acquire) <= size;
+        }
+        static Ring *make(std::size_t size, bool huge, int node)
+        {
+            std::size_t bytes = size * sizeof(Slot);
+            Slot *slots = static_cast<Slot *>(detail::map_slots(bytes, huge, node));
+            return new (detail::alloc_aligned(sizeof(Ring))) Ring(size, slots, bytes);
+        }
+        static void destroy(Ring *ring)
+        {
+            detail::unmap_slots(ring->slots, ring->bytes);
+            ring->~Ring();
+            detail::free_aligned(ring);
+        }
+    };
+    /**
+     * the backend's claim on a lane: the records [pos, end) of ring, which producers leave alone. ring, pos and end are atomic, as
+     * visit_all_queued reads them without a lock; only the backend moves pos, so relaxed loads and stores do
+     */
+    struct Claim
+    {
+        Ring *front = nullptr; /**< the oldest ring not freed yet */
+        std::atomic<Ring *> ring{nullptr};
+        std::atomic<std::size_t> pos{0};
+        std::atomic<std::size_t> end{0};
+        bool empty() const { return pos.load(std::memory_order_relaxed) == end.load(std::memory_order_relaxed); }
+        Record &record() { return ring.load(std::memory_order_relaxed)->at(pos.load(std::memory_order_relaxed)); }
+        /** moves past the current record and any padding after it, handing the slots back once the claim is used up */
+        void pop() { skip_padding(pos.load(std::memory_order_relaxed) + record().slots); }
+        void skip_padding(std::size_t at)
+        {
+            Ring *r = ring.load(std::memory_order_relaxed);
+            std::size_t stop = end.load(std::memory_order_relaxed);
+            while (at != stop && r->header(at).padding)
+            {
+                at += r->header(at).slots;
+            }
+            pos.store(at, std::memory_order_relaxed);
+            if (at == stop && r != nullptr)
+            {
+                r->tail.store(stop, std::memory_order_release);
+            }
+        }
+        void set(Ring *r, std::size_t from, std::size_t to)
+        {
+            ring.store(r, std::memory_order_relaxed);
+            pos.store(from, std::memory_order_relaxed);
+            end.store(to, std::memory_order_relaxed);
+        }
+    };
+    /** the records one producer thread has queued */
+    struct Buffer
+    {
+        std::thread::id owner;
+        std::mutex mtx;
+        std::condition_variable space;
+        Ring *back[4];      /**< the ring each lane appends to, under mtx. By severity with priority_lanes, otherwise only lane 0 is used */
+        Ring *unclaimed[4]; /**< the ring holding each lane's oldest unclaimed record, under mtx */
+        std::atomic<std::size_t> queued{0}; /**< unclaimed records */
+        std::atomic<std::size_t> pending[4]; /**< queued or claimed and not forwarded yet, per lane. This is what the capacity bounds */
+        std::atomic<unsigned int> blocked{0};
+        Claim claims[4]; /**< the backend's own, except front which is set under mtx when the first ring is made */
+        detail::Version version; /**< of the rings and claims, changed under mtx, for visit_all_queued */
+        bool huge;       /**< AsyncOptions::huge_pages */
+        int node;        /**< AsyncOptions::node */
+        std::atomic<bool> retired{false}; /**< its sink is gone, or stayed behind in the parent of a fork, so no thread logs to it again */
+        Buffer(bool huge, int node) : owner(std::this_thread::get_id()), huge(huge), node(node)
+        {
+            for (int l = 0; l < 4; l++)
+            {
+                back[l] = unclaimed[l] = nullptr;
+                pending[l].store(0, std::memory_order_relaxed);
+            }
+        }
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+        ~Buffer() { release_rings(); }
+        /** frees every ring, whatever is still queued in them. Needs mtx, or the buffer to be the caller's alone */
+        void release_rings()
+        {
+            for (int l = 0; l < 4; l++)
+            {
+                while (claims[l].front != nullptr)
+                {
+                    Ring *next = claims[l].front->next;
+                    Ring::destroy(claims[l].front);
+                    claims[l].front = next;
+                }
+                claims[l].set(nullptr, 0, 0);
+                back[l] = unclaimed[l] = nullptr;
+            }
+        }
+        bool empty() const
+        {
+            for (const std::atomic<std::size_t> &p : pending)
+            {
+                if (p.load() != 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        /** room for a record of n slots at the back of lane l, in a new ring twice the size if it doesn't fit. Needs mtx */
+        void *reserve(int l, std::size_t n)
+        {
+            Ring *r = back[l];
+            std::size_t pad = 0;
+            if (r != nullptr && !r->fits(n, pad) && r->oldest != r->claimed)
+            {
+                // the slots of records dropped before the backend claimed them are free, unless it's still busy with an earlier claim
+                std::size_t done = r->claimed;
+                if (claims[l].ring.load(std::memory_order_relaxed) != r)
+                {
+                    r->tail.store(r->oldest, std::memory_order_release);
+                }
+                else
+                {
+                    r->tail.compare_exchange_strong(done, r->oldest);
+                }
+            }
+            if (r == nullptr || !r->fits(n, pad))
+            {
+                std::size_t first = huge ? std::max<std::size_t>(SLOG_ASYNC_RING, detail::huge_page / sizeof(Slot)) : SLOG_ASYNC_RING;
+                std::size_t size = r != nullptr ? r->size * 2 : first;
+                while (size < n)
+                {
+                    size *= 2;
+                }
+                // rings are only made by their producer, so its node is the one it's running on now
+                Ring *fresh = Ring::make(size, huge, node >= 0 ? node : detail::current_node());
+                if (r == nullptr)
+                {
+                    claims[l].front = unclaimed[l] = fresh;
+                }
+                else
+                {
+                    r->next = fresh;
+                }
+                r = back[l] = fresh;
+                pad = 0;
+            }
+            if (pad != 0)
+            {
+                Header *filler = new (r->slot(r->head)) Header;
+                filler->slots = static_cast<std::uint32_t>(pad);
+                filler->padding = true;
+                r->head += pad;
+            }
+            void *slot = r->slot(r->head);
+            r->head += n;
+            r->records++;
+            return slot;
+        }
+        /** the lane's oldest unclaimed record, or null. Needs mtx */
+        Record *oldest(int l)
+        {
+            for (Ring *r = unclaimed[l]; r != nullptr; r = unclaimed[l] = r->next)
+            {
+                while (r->oldest != r->head && r->header(r->oldest).padding)
+                {
+                    r->oldest += r->header(r->oldest).slots;
+                }
+                if (r->oldest != r->head)
+                {
+                    return &r->at(r->oldest);
+                }
+                if (r->next == nullptr)
+                {
+                    break;
+                }
+            }
+            return nullptr;
+        }
+        /** unqueues the record oldest(l) returned, leaving its slots for the backend to hand back. Needs mtx */
+        void drop_oldest(int l)
+        {
+            Ring *r = unclaimed[l];
+            r->oldest += r->at(r->oldest).slots;
+            r->records--;
+            pending[l]--;
+            queued--;
+        }
+        /** gives the backend lane l's unclaimed records, once it's through with its previous claim. Needs mtx */
+        void claim(int l)
+        {
+            Claim &c = claims[l];
+            if (!c.empty() || oldest(l) == nullptr)
+            {
+                return;
+            }
+            Ring *r = unclaimed[l];
+            c.set(r, r->oldest, r->head);
+            r->oldest = r->claimed = r->head;
+            queued -= r->records;
+            r->records = 0;
+            if (r->next != nullptr)
+            {
+                unclaimed[l] = r->next;
+            }
+            // the rings before this one have been handed back in full
+            while (c.front != r)
+            {
+                Ring *next = c.front->next;
+                Ring::destroy(c.front);
+                c.front = next;
+            }
+        }
+    };
+    /** the front of one buffer's lane, in the merge heap */
+    struct Head
+    {
+        unsigned long long stamp;
+        Buffer *buffer;
+    };
+    /** orders the merge heap earliest first */
+    struct Later
+    {
+        bool operator()(const Head &a, const Head &b) const { return a.stamp > b.stamp; }
+    };
+    Sink &target;
+    AsyncOptions opt;
+    unsigned long long id; /**< tells this sink's buffers apart in the thread_local cache */
+    std::mutex registry_mtx;
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    detail::Version registry_version; /**< of buffers, changed under registry_mtx, for visit_all_queued */
+    std::atomic<unsigned int> generation{0}; /**< bumped when the backend should take a new snapshot of buffers */
+    std::atomic<unsigned long long> arrivals{0};
+    std::mutex mtx;
+    std::condition_variable idle;
+    std::atomic<bool> busy{false};
+    detail::Parker parker;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> forking{false}; /**< the backend should pause for a fork, set between before_fork and after_fork */
+    std::atomic<bool> fork_flushed{false}; /**< the backend flushed the target on its way out of loop() for a fork */
+    bool fork_driven = false;  /**< before_fork got hold of drive_mtx in time, rather than leave the backend stuck in the target */
+    bool fork_restart = false; /**< the child still has to run on_fork_child and start its backend */
+    std::atomic<bool> closed{false}; /**< by slog::shutdown, after which whoever logs a record forwards it */
+    std::atomic<bool> abandoned{false}; /**< the backend was still busy at the shutdown deadline, and was left to it. Set by close() */
+    std::atomic<bool> unowned{false}; /**< the sink was destroyed with the backend still abandoned, which now only drops records */
+    std::atomic<unsigned int> draining{0}; /**< flushes waiting, which forward everything without waiting out the reorder window */
+    std::atomic<unsigned long long> drops[4];
+    std::atomic<unsigned long long> unreported{0};
+    std::mutex drive_mtx; /**< held by whichever thread is running the backend: its own, run(), poll(), or flush() if there's neither */
+    std::vector<Buffer *> active; /**< the rest belongs to the thread holding drive_mtx */
+    std::vector<Head> heap;
+    std::chrono::steady_clock::time_point held_since[4]; /**< when merge() started holding back each lane's earliest record */
+    std::string msg; /**< what forward() hands the target, reused so it only allocates for the longest message */
+    unsigned int seen;
+    std::chrono::steady_clock::time_point last_report;
+    std::thread worker;
+    static unsigned long long next_id()
+    {
+        static std::atomic<unsigned long long> ids{0};
+        return ++ids;
+    }
+    static void release(Record &rec)
+    {
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+        Tags(rec.tags).release();
+#else
+        (void)rec;
+#endif
+    }
+    static unsigned long long nanos(std::chrono::time_point<std::chrono::system_clock> time)
+    {
+        return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+    }
+    void count_drop(Severity sev)
+    {
+        drops[static_cast<int>(sev)].fetch_add(1, std::memory_order_relaxed);
+        unreported.fetch_add(1, std::memory_order_relaxed);
+        metrics_note_dropped(1);
+    }
+    /** the most severe records are forwarded from at most this many at a time, so a newly queued ERROR never waits behind many more */
+    static constexpr std::size_t lane_batch = 64;
+    int lane_of(Severity sev) const { return opt.priority_lanes ? static_cast<int>(sev) : 0; }
+    /**
+     * the calling thread's buffer, looked up in a thread_local cache so the registry lock is only taken the first time the thread
+     * logs to the sink. The cache holds one entry per sink, which keeps the buffer from being collected until the thread exits
+     */
+    Buffer &buffer()
+    {
+        struct Cached
+        {
+            unsigned long long sink;
+            std::shared_ptr<Buffer> buffer;
+        };
+        static thread_local std::vector<Cached> cache;
+        for (Cached &c : cache)
+        {
+            if (c.sink == id)
+            {
+                return *c.buffer;
+            }
+        }
+        cache.erase(std::remove_if(cache.begin(), cache.end(), [](const Cached &c) { return c.buffer->retired.load(); }), cache.end());
+        cache.push_back(Cached{id, attach()});
+        return *cache.back().buffer;
+    }
+    std::shared_ptr<Buffer> attach()
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        std::thread::id self = std::this_thread::get_id();
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            if (b->owner == self)
+            {
+                return b;
+            }
+        }
+        std::shared_ptr<Buffer> fresh = std::make_shared<Buffer>(opt.huge_pages, opt.node);
+        {
+            detail::Version::Change change(registry_version);
+            buffers.push_back(fresh);
+        }
+        generation++;
+        return buffers.back();
+    }
+    /** applies the overflow policy to a full lane. Returns whether the new record should be queued */
+    bool make_room(std::unique_lock<std::mutex> &lock, Buffer &b, int lane, Severity sev)
+    {
+        switch (opt.overflow)
+        {
+        case Overflow::BLOCK:
+        {
+            b.blocked++;
+            bool room = b.space.wait_for(lock, opt.block_timeout, [this, &b, lane] { return stop.load() || b.pending[lane].load() < opt.capacity; });
+            b.blocked--;
+            return room;
+        }
+        case Overflow::DROP_OLDEST:
+        {
+            detail::Version::Change change(b.version);
+            Record *oldest = b.oldest(lane);
+            if (oldest == nullptr)
+            {
+                // everything waiting has already been claimed by the backend
+                return false;
+            }
+            count_drop(static_cast<Severity>(oldest->sev));
+            release(*oldest);
+            b.drop_oldest(lane);
+            return true;
+        }
+        case Overflow::DROP_BELOW: return sev >= opt.drop_below || sev == Severity::ERROR;
+        default: return false;
+        }
+    }
+    /** copies the record into the calling thread's buffer */
+    void push(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        // a record has room to count this many, which no call to SLOG_KV comes near
+        std::size_t nfields = std::min<std::size_t>(fields.size(), 0xffff);
+        std::size_t text_size = 0;
+        for (std::size_t i = 0; i < nfields; i++)
+        {
+            text_size += fields[i].type == Field::Type::STRING ? fields[i].str.size : 0;
+        }
+        Buffer &b = buffer();
+        int lane = lane_of(sev);
+        {
+            std::unique_lock<std::mutex> lock(b.mtx);
+            if (opt.capacity != 0 && b.pending[lane].load() >= opt.capacity && !make_room(lock, b, lane, sev))
+            {
+                lock.unlock();
+                count_drop(sev);
+                return;
+            }
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+            bool foreign = ctx.thread_id != b.owner;
+#else
+            bool foreign = false;
+#endif
+            std::size_t slots = Record::slots_for(foreign, nfields, msg.size(), text_size);
+            detail::Version::Change change(b.version);
+            Record *rec = new (b.reserve(lane, slots)) Record;
+            rec->slots = static_cast<std::uint32_t>(slots);
+            rec->padding = false;
+            rec->foreign = foreign;
+            rec->sev = static_cast<std::uint8_t>(sev);
+            rec->nfields = static_cast<std::uint16_t>(nfields);
+            rec->msg_size = static_cast<std::uint32_t>(msg.size());
+            rec->store(ctx);
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) == 0
+            rec->arrival = arrivals.fetch_add(1, std::memory_order_relaxed);
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+            // the tags are snapshotted by reference, they're only released once the backend is done with the record
+            ctx.tags.retain();
+#endif
+            if (nfields != 0)
+            {
+                std::memcpy(static_cast<void *>(rec->fields()), fields.begin(), nfields * sizeof(Field));
+            }
+            std::memcpy(rec->msg(), msg.data(), msg.size());
+            // string field values are only borrowed from the caller, so they're pointed at their copies, which never move
+            char *text = rec->text();
+            Field *copies = rec->fields();
+            for (std::size_t i = 0; i < nfields; i++)
+            {
+                if (fields[i].type == Field::Type::STRING)
+                {
+                    std::memcpy(text, fields[i].str.data, fields[i].str.size);
+                    copies[i].str.data = text;
+                    text += fields[i].str.size;
+                }
+            }
+            metrics_note_queue_depth(++b.pending[lane]);
+            b.queued++;
+        }
+        // the backend announces it's parking before it looks at queued one last time, so either it sees the record or we see it parked
+        parker.unpark();
+        if (closed.load())
+        {
+            std::lock_guard<std::mutex> drive(drive_mtx);
+            drain();
+        }
+    }
+    /** the record's fields, whose string values point at their copies in the ring */
+    static Fields fields_of(Record &rec) { return Fields(rec.fields(), rec.nfields); }
+    void forward(Record &rec, std::thread::id owner)
+    {
+        if (unowned.load())
+        {
+            // the target may well be gone with the sink
+            return;
+        }
+        msg.assign(rec.msg(), rec.msg_size);
+        if (rec.nfields == 0)
+        {
+            target.record(static_cast<Severity>(rec.sev), rec.context(owner), msg);
+            return;
+        }
+        target.record_fields(static_cast<Severity>(rec.sev), rec.context(owner), msg, fields_of(rec));
+    }
+    /** the live sinks, for visit_all_queued. Filled in without locks, so it can be read from a signal handler */
+    static std::atomic<AsyncCore *> *visitable()
+    {
+        static std::atomic<AsyncCore *> sinks[SLOG_ASYNC_SINKS];
+        return sinks;
+    }
+    template <typename F> static void visit(Record &rec, std::thread::id owner, F &f)
+    {
+        f(static_cast<Severity>(rec.sev), rec.context(owner), rec.msg(), static_cast<std::size_t>(rec.msg_size), fields_of(rec));
+    }
+    /**
+     * visit_all_queued for this sink, reading the registry and each buffer without a lock or a write. A buffer that's being changed
+     * is skipped, and one that changes under it is left at the record it had got to. Returns false if either happened
+     */
+    template <typename F> bool visit_queued(F &f)
+    {
+        unsigned int registry_seen = registry_version.read();
+        if (registry_seen % 2 != 0)
+        {
+            return false;
+        }
+        bool all = true;
+        for (const std::shared_ptr<Buffer> &ptr : buffers)
+        {
+            if (!registry_version.still(registry_seen))
+            {
+                return false;
+            }
+            Buffer &b = *ptr;
+            unsigned int seen = b.version.read();
+            std::thread::id owner = b.owner;
+            all = seen % 2 == 0 && each_queued(b, [&f, &b, seen, owner](Record &rec) {
+                if (!b.version.still(seen))
+                {
+                    return false;
+                }
+                visit(rec, owner, f);
+                return true;
+            }) && all;
+        }
+        return all;
+    }
+    /**
+     * calls f(rec) for each record in the buffer not forwarded yet, oldest first in each lane, until it returns false. Returns
+     * whether it got through them all. Needs b.mtx, or f to check b.version, in which case a torn read still ends the walk
+     */
+    template <typename F> static bool each_queued(Buffer &b, F f)
+    {
+        for (int l = 0; l < 4; l++)
+        {
+            // what the backend claimed but hasn't forwarded yet, then what it hasn't claimed
+            const Claim &c = b.claims[l];
+            if (!each_in(c.ring.load(std::memory_order_relaxed), c.pos.load(std::memory_order_relaxed), c.end.load(std::memory_order_relaxed), f))
+            {
+                return false;
+            }
+            for (Ring *r = b.unclaimed[l]; r != nullptr; r = r->next)
+            {
+                if (!each_in(r, r->oldest, r->head, f))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    /** each_queued for the slots [from, to) of r */
+    template <typename F> static bool each_in(Ring *r, std::size_t from, std::size_t to, F &f)
+    {
+        for (std::size_t i = from; r != nullptr && i < to; i += r->header(i).slots)
+        {
+            if (r->header(i).slots == 0 || (!r->header(i).padding && !f(r->at(i))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    /** tells the target how many records were dropped since the last report */
+    void report_drops()
+    {
+        unsigned long long n = unreported.exchange(0, std::memory_order_relaxed);
+        if (n == 0 || unowned.load())
+        {
+            return;
+        }
+        std::string msg;
+        detail::append_uint(msg, n);
+        msg += n == 1 ? " record dropped" : " records dropped";
+        Field count = detail::make_field("dropped", n);
+        target.record_fields(Severity::WARN, make_ctx(__FILE__, __LINE__, __FUNCTION__), msg, Fields(&count, 1));
+    }
+    /** whether the buffer's thread has exited and it has nothing left to forward. Needs registry_mtx */
+    static bool orphaned(const std::shared_ptr<Buffer> &b)
+    {
+        // the registry holds one reference and the owner's thread_local cache the other
+        return b.use_count() == 1 && b->empty();
+    }
+    /** snapshots the registry for the backend, forgetting orphaned buffers */
+    void refresh(std::vector<Buffer *> &active)
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        if (std::any_of(buffers.begin(), buffers.end(), orphaned))
+        {
+            detail::Version::Change change(registry_version);
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), orphaned), buffers.end());
+        }
+        active.clear();
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            active.push_back(b.get());
+        }
+    }
+    /** whether any buffer has records the backend hasn't staged yet. Needs registry_mtx */
+    bool incoming() const
+    {
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            if (b->queued.load() != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    /** whether every record queued so far has been forwarded. Needs registry_mtx */
+    bool drained() const
+    {
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            if (!b->empty())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    /** claims each lane of each buffer once the backend is through with its previous claim, so a producer only waits on a few stores */
+    void collect(std::vector<Buffer *> &active)
+    {
+        for (Buffer *b : active)
+        {
+            if (b->queued.load() == 0)
+            {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(b->mtx);
+            detail::Version::Change change(b->version);
+            for (int l = 0; l < 4; l++)
+            {
+                b->claim(l);
+            }
+        }
+    }
+    /**
+     * forwards claimed records from the most severe lane that has any the reorder window lets through, earliest first across all
+     * buffers. The heads of the buffers sit in a min-heap, so each record costs at most O(log threads). Returns how many were forwarded, or
+     * sets due to when the first held back record may go. Records are held for at most the window as the steady clock counts it, so
+     * ones stamped before the wall clock stepped back don't wait for it to catch up
+     */
+    std::size_t merge(std::vector<Buffer *> &active, std::vector<Head> &heap, bool everything,
+                      std::chrono::steady_clock::time_point &due)
+    {
+        unsigned long long cutoff = ~0ULL;
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+        unsigned long long window = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(opt.reorder_window).count());
+        if (!everything && window != 0)
+        {
+            cutoff = nanos(std::chrono::system_clock::now()) - window;
+        }
+#else
+        (void)everything;
+#endif
+        for (int l = 3; l >= 0; l--)
+        {
+            heap.clear();
+            for (Buffer *b : active)
+            {
+                if (!b->claims[l].empty())
+                {
+                    heap.push_back(Head{b->claims[l].record().stamp(), b});
+                }
+            }
+            if (heap.empty())
+            {
+                continue;
+            }
+            std::make_heap(heap.begin(), heap.end(), Later());
+            if (heap.front().stamp > cutoff)
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (held_since[l] == std::chrono::steady_clock::time_point::max())
+                {
+                    held_since[l] = now;
+                }
+                if (now - held_since[l] < opt.reorder_window)
+                {
+                    std::chrono::steady_clock::time_point aged = now + std::chrono::nanoseconds(heap.front().stamp - cutoff);
+                    due = std::min(due, std::min(aged, held_since[l] + opt.reorder_window));
+                    continue;
+                }
+                // held the whole window and still too new by the wall clock: let everything claimed go, in order
+                cutoff = ~0ULL;
+            }
+            held_since[l] = std::chrono::steady_clock::time_point::max();
+            std::size_t sent = 0;
+            while (!heap.empty() && heap.front().stamp <= cutoff && (!opt.priority_lanes || sent < lane_batch))
+            {
+                std::pop_heap(heap.begin(), heap.end(), Later());
+                Buffer &b = *heap.back().buffer;
+                heap.pop_back();
+                // forward this buffer's records for as long as they're earlier than every other buffer's, without touching the heap
+                unsigned long long bound = heap.empty() ? cutoff : std::min(cutoff, heap.front().stamp);
+                Claim &c = b.claims[l];
+                do
+                {
+                    Record &rec = c.record();
+                    b.pending[l]--;
+                    if (b.blocked.load() != 0)
+                    {
+                        std::lock_guard<std::mutex> lock(b.mtx);
+                        b.space.notify_all();
+                    }
+                    forward(rec, b.owner);
+                    release(rec);
+                    c.pop();
+                    sent++;
+                } while (!c.empty() && c.record().stamp() <= bound && (!opt.priority_lanes || sent < lane_batch));
+                if (!c.empty())
+                {
+                    heap.push_back(Head{c.record().stamp(), &b});
+                    std::push_heap(heap.begin(), heap.end(), Later());
+                }
+            }
+            return sent;
+        }
+        return 0;
+    }
+    /** whether the backend has anything to do besides wait for the reorder window or the drop report */
+    bool ready(const std::vector<Buffer *> &active, unsigned int seen) const
+    {
+        if (stop.load() || forking.load() || draining.load() != 0 || generation.load() != seen)
+        {
+            return true;
+        }
+        for (Buffer *b : active)
+        {
+            if (b->queued.load() != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    /** waits for work or until due: spins, then yields, then parks */
+    void wait(const std::vector<Buffer *> &active, unsigned int seen, std::chrono::steady_clock::time_point due)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point now = start;
+        while (now < start + opt.idle_spin && now < due)
+        {
+            if (ready(active, seen))
+            {
+                return;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                detail::cpu_relax();
+            }
+            now = std::chrono::steady_clock::now();
+        }
+        while (now < start + opt.idle_spin + opt.idle_yield && now < due)
+        {
+            if (ready(active, seen))
+            {
+                return;
+            }
+            std::this_thread::yield();
+            now = std::chrono::steady_clock::now();
+        }
+        {
+            std::lock_guard<std::mutex> lock(registry_mtx);
+            if (std::any_of(buffers.begin(), buffers.end(), orphaned))
+            {
+                generation++;
+            }
+        }
+        parker.prepare();
+        if (ready(active, seen))
+        {
+            parker.cancel();
+            return;
+        }
+        parker.park(due);
+    }
+    /** one pass of the backend: stages new records, then merges and forwards what's ready. Needs drive_mtx */
+    std::size_t step(bool everything, std::chrono::steady_clock::time_point &due)
+    {
+        if (generation.load() != seen)
+        {
+            seen = generation.load();
+            refresh(active);
+            // merge() holds at most one head per buffer, so it needn't allocate as records from more threads come in
+            heap.reserve(active.size());
+        }
+        collect(active);
+        busy = true;
+        std::size_t sent = merge(active, heap, everything || draining.load() != 0, due);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (everything || now - last_report >= opt.drop_report_period)
+        {
+            report_drops();
+            last_report = now;
+        }
+        busy = false;
+        if (draining.load() != 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            idle.notify_all();
+        }
+        return sent;
+    }
+    /** forwards everything that's queued, on the calling thread. Needs drive_mtx */
+    void drain()
+    {
+        while (true)
+        {
+            std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+            if (step(true, due) == 0)
+            {
+                std::lock_guard<std::mutex> lock(registry_mtx);
+                if (drained())
+                {
+                    return;
+                }
+            }
+        }
+    }
+    /**
+     * the backend loop, which returns once the sink is being destroyed and everything has been forwarded, or for a fork after one last
+     * pass over what's queued. Needs drive_mtx
+     */
+    void loop()
+    {
+        while (true)
+        {
+            bool stopping = stop.load();
+            bool pausing = forking.load();
+            std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+            if (step(stopping || pausing, due) != 0 && !pausing)
+            {
+                continue;
+            }
+            if (pausing)
+            {
+                // or the child inherits whatever the target had buffered, and writes it out a second time
+                target.flush();
+                fork_flushed = true;
+                // producers may keep it busy forever; what they queue meanwhile is forwarded after the fork
+                return;
+            }
+            if (stopping)
+            {
+                std::lock_guard<std::mutex> lock(registry_mtx);
+                if (!incoming())
+                {
+                    return;
+                }
+                continue;
+            }
+            if (unreported.load(std::memory_order_relaxed) != 0)
+            {
+                // wake up for the drop report even if nothing else arrives
+                due = std::min(due, last_report + opt.drop_report_period);
+            }
+            wait(active, seen, due);
+        }
+    }
+    /** tells the target a placement setting couldn't be applied to the backend thread */
+    void report_placement(const char *what, int err)
+    {
+        std::string msg = "couldn't set the async backend thread's ";
+        msg += what;
+        Field error = detail::make_field("error", std::strerror(err));
+        target.record_fields(Severity::WARN, make_ctx(__FILE__, __LINE__, __FUNCTION__), msg, Fields(&error, 1));
+    }
+    /** applies the placement settings to the calling thread */
+    void place()
+    {
+#ifdef __linux__
+        std::vector<int> cpus = opt.cpus.empty() && opt.node >= 0 ? detail::node_cpus(opt.node) : opt.cpus;
+        if (!cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus)
+            {
+                CPU_SET(cpu, &set);
+            }
+            int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (err != 0)
+            {
+                report_placement("CPU affinity", err);
+            }
+        }
+        if (opt.sched_policy >= 0)
+        {
+            sched_param param;
+            param.sched_priority = opt.sched_priority;
+            int err = pthread_setschedparam(pthread_self(), opt.sched_policy, &param);
+            if (err != 0)
+            {
+                report_placement("scheduling policy", err);
+            }
+        }
+        // on Linux the nice value is per thread
+        if (opt.nice != 0 && setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), getpriority(PRIO_PROCESS, 0) + opt.nice) != 0)
+        {
+            report_placement("nice value", errno);
+        }
+        if (!opt.thread_name.empty())
+        {
+            pthread_setname_np(pthread_self(), opt.thread_name.substr(0, 15).c_str());
+        }
+#endif
+    }
+    /** tells the backend to finish up, and wakes any producers blocked on a full buffer */
+    void halt()
+    {
+        stop = true;
+        parker.unpark();
+        std::lock_guard<std::mutex> registry(registry_mtx);
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            std::lock_guard<std::mutex> lock(b->mtx);
+            b->space.notify_all();
+        }
+    }
+    void backend()
+    {
+        place();
+        run();
+    }
+public:
+    /** for slog::shutdown: forwards what's queued, stops the backend and from then on has each record forwarded by its producer */
+    bool close(std::chrono::steady_clock::time_point deadline)
+    {
+        if (stop.load())
+        {
+            return !abandoned;
+        }
+        bool in_time = flush_until(deadline);
+        halt();
+        std::unique_lock<std::mutex> drive(drive_mtx, std::defer_lock);
+        if (!in_time || !detail::lock_until(drive, deadline))
+        {
+            // the target is stuck: leave the backend to it rather than hold up the exit
+            abandoned = true;
+            if (worker.joinable())
+            {
+                worker.detach();
+            }
+            return false;
+        }
+        closed = true;
+        drain();
+        target.flush();
+        drive.unlock();
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+        return true;
+    }
+    /**
+     * has the backend forward what it holds and step aside, then takes every lock, so the child of a fork finds no record half queued
+     * and no lock held by a thread it lacks. A backend still stuck in the target after SLOG_FORK_TIMEOUT_MS is left to it, with the
+     * records behind it kept queued, rather than hold up the fork
+     */
+    void before_fork()
+    {
+        fork_driven = false;
+        if (!abandoned)
+        {
+            fork_flushed = false;
+            forking = true;
+            parker.unpark();
+            std::unique_lock<std::mutex> drive(drive_mtx, std::defer_lock);
+            if (detail::lock_until(drive, std::chrono::steady_clock::now() + std::chrono::milliseconds(SLOG_FORK_TIMEOUT_MS)))
+            {
+                // with nothing in run() there was no one else to flush the target
+                if (!fork_flushed.exchange(false))
+                {
+                    target.flush();
+                }
+                fork_driven = true;
+                drive.release();
+            }
+        }
+        mtx.lock();
+        registry_mtx.lock();
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            b->mtx.lock();
+        }
+    }
+    /**
+     * undoes before_fork, which lets the backend carry on in the parent. The child only has the thread that forked, so the records
+     * the other threads had queued are dropped along with their buffers: they're the parent's to forward. Its backend is started by
+     * start_in_child, once the registry of sinks is unlocked
+     */
+    void after_fork(bool child)
+    {
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            if (child)
+            {
+                each_queued(*b, [](Record &rec) {
+                    release(rec);
+                    return true;
+                });
+                b->retired = true;
+                // other threads may have been waiting on it; the child's copy is only safe to destroy once it's made anew
+                new (&b->space) std::condition_variable();
+            }
+            b->mtx.unlock();
+        }
+        if (child)
+        {
+            detail::Version::Change change(registry_version);
+            buffers.clear();
+            // a new id misses every thread_local cache, so the forking thread attaches a fresh buffer too
+            id = next_id();
+            generation++;
+            active.clear();
+            heap.clear();
+            busy = false;
+            draining = 0;
+            fork_flushed = false;
+            new (&idle) std::condition_variable();
+            new (&parker) detail::Parker();
+            // the backend thread isn't there to join, or to unlock drive_mtx if it was stuck with it
+            new (&worker) std::thread();
+            if (!fork_driven)
+            {
+                new (&drive_mtx) std::mutex();
+            }
+            fork_restart = !abandoned;
+        }
+        registry_mtx.unlock();
+        mtx.unlock();
+        if (fork_driven)
+        {
+            drive_mtx.unlock();
+        }
+        forking = false;
+        if (!child)
+        {
+            // back to loop(), in the backend thread or run()
+            parker.unpark();
+        }
+    }
+    /** runs on_fork_child, then starts the child's backend */
+    void start_in_child()
+    {
+        if (!fork_restart)
+        {
+            return;
+        }
+        fork_restart = false;
+        if (opt.on_fork_child)
+        {
+            opt.on_fork_child();
+        }
+        if (!stop.load())
+        {
+            start();
+        }
+    }
+    explicit AsyncCore(Sink &target, const AsyncOptions &opt)
+        : target(target), opt(opt), id(next_id()), seen(generation.load() - 1), worker()
+    {
+        if (std::thread::hardware_concurrency() == 1)
+        {
+            this->opt.idle_spin = this->opt.idle_yield = std::chrono::microseconds(0);
+        }
+        for (std::atomic<unsigned long long> &d : drops)
+        {
+            d.store(0, std::memory_order_relaxed);
+        }
+        for (std::chrono::steady_clock::time_point &h : held_since)
+        {
+            h = std::chrono::steady_clock::time_point::max();
+        }
+        for (int i = 0; i < SLOG_ASYNC_SINKS; i++)
+        {
+            AsyncCore *none = nullptr;
+            if (visitable()[i].compare_exchange_strong(none, this))
+            {
+                break;
+            }
+        }
+    };
+    AsyncCore(const AsyncCore &) = delete;
+    AsyncCore &operator=(const AsyncCore &) = delete;
+    /** starts the backend thread, with own_thread. It holds a reference to the core until it returns */
+    void start()
+    {
+        if (!opt.own_thread)
+        {
+            return;
+        }
+        std::shared_ptr<AsyncCore> self = shared_from_this();
+        worker = std::thread([self] { self->backend(); });
+    }
+    void record(Severity sev, const Context &ctx, const std::string &msg) { push(sev, ctx, msg, Fields()); }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields) { push(sev, ctx, msg, fields); }
+    unsigned long long dropped(Severity sev) const { return drops[static_cast<int>(sev)].load(std::memory_order_relaxed); }
+    unsigned long long dropped() const
+    {
+        unsigned long long total = 0;
+        for (const std::atomic<unsigned long long> &d : drops)
+        {
+            total += d.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+    void run()
+    {
+        std::unique_lock<std::mutex> drive(drive_mtx);
+        while (true)
+        {
+            loop();
+            if (stop.load())
+            {
+                return;
+            }
+            // loop() stepped aside for a fork: wait it out, then carry on. In the child this thread is gone, and another takes over
+            drive.unlock();
+            while (forking.load())
+            {
+                parker.prepare();
+                if (!forking.load())
+                {
+                    parker.cancel();
+                    break;
+                }
+                parker.park(std::chrono::steady_clock::time_point::max());
+            }
+            drive.lock();
+        }
+    }
+    std::size_t poll()
+    {
+        std::unique_lock<std::mutex> drive(drive_mtx, std::try_to_lock);
+        if (!drive.owns_lock())
+        {
+            return 0;
+        }
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::time_point::max();
+        return step(false, due);
+    }
+    template <typename F> static bool visit_all_queued(F &&f)
+    {
+        bool all = true;
+        for (int i = 0; i < SLOG_ASYNC_SINKS; i++)
+        {
+            AsyncCore *core = visitable()[i].load();
+            all = (core == nullptr || core->visit_queued(f)) && all;
+        }
+        return all;
+    }
+    bool flush_until(std::chrono::steady_clock::time_point deadline)
+    {
+        if (closed.load())
+        {
+            std::lock_guard<std::mutex> drive(drive_mtx);
+            drain();
+            return true;
+        }
+        if (!opt.own_thread)
+        {
+            std::unique_lock<std::mutex> drive(drive_mtx, std::try_to_lock);
+            if (drive.owns_lock())
+            {
+                drain();
+                return true;
+            }
+        }
+        draining++;
+        parker.unpark();
+        std::unique_lock<std::mutex> lock(mtx);
+        auto done = [this] {
+            std::lock_guard<std::mutex> registry(registry_mtx);
+            return !busy && drained();
+        };
+        bool in_time = true;
+        if (deadline == std::chrono::steady_clock::time_point::max())
+        {
+            idle.wait(lock, done);
+        }
+        else
+        {
+            in_time = idle.wait_until(lock, deadline, done);
+        }
+        draining--;
+        return in_time;
+    }
+    /**
+     * for ~AsyncSink: forwards what's left and stops the backend. A backend slog::shutdown left stuck is given
+     * SLOG_SHUTDOWN_TIMEOUT_MS more, then left running with its own reference to the core, dropping the rest of the records
+     */
+    void destroy()
+    {
+        for (int i = 0; i < SLOG_ASYNC_SINKS; i++)
+        {
+            AsyncCore *self = this;
+            visitable()[i].compare_exchange_strong(self, nullptr);
+        }
+        halt();
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+        std::unique_lock<std::mutex> drive(drive_mtx, std::defer_lock);
+        if (!abandoned)
+        {
+            drive.lock();
+        }
+        else if (!detail::lock_until(drive, std::chrono::steady_clock::now() + std::chrono::milliseconds(SLOG_SHUTDOWN_TIMEOUT_MS)))
+        {
+            unowned = true;
+            return;
+        }
+        drain();
+        // the producers' thread_local caches may keep the buffers themselves around for a while, but not their rings
+        std::lock_guard<std::mutex> registry(registry_mtx);
+        for (const std::shared_ptr<Buffer> &b : buffers)
+        {
+            std::lock_guard<std::mutex> lock(b->mtx);
+            detail::Version::Change change(b->version);
+            b->release_rings();
+            b->retired = true;
+        }
+    }
+};
+} // namespace detail
+
+/**
+ * A sink that queues records and forwards them to another sink from a backend thread. Each producer thread queues into its own buffer,
+ * so producers only ever contend with the backend, which merges the buffers back into one stream ordered by Context::time
+ */
+class AsyncSink : public Sink, private detail::Closeable
+{
+private:
+    std::shared_ptr<detail::AsyncCore> core;
+    bool close(std::chrono::steady_clock::time_point deadline) override { return core->close(deadline); }
+    void before_fork() override { core->before_fork(); }
+    void after_fork(bool child) override { core->after_fork(child); }
+    void start_in_child() override { core->start_in_child(); }
+public:
+    explicit AsyncSink(Sink &target, const AsyncOptions &opt = AsyncOptions()) : core(std::make_shared<detail::AsyncCore>(target, opt))
+    {
+        core->start();
+        detail::add_closeable(this);
+    };
+    AsyncSink(const AsyncSink &) = delete;
+    AsyncSink &operator=(const AsyncSink &) = delete;
+    void record(Severity sev, const Context &ctx, const std::string &msg) override { core->record(sev, ctx, msg); }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields) override
+    {
+        core->record_fields(sev, ctx, msg, fields);
+    }
+    /** how many records of severity sev have been dropped by the overflow policy */
+    unsigned long long dropped(Severity sev) const { return core->dropped(sev); }
+    /** how many records have been dropped by the overflow policy in total */
+    unsigned long long dropped() const { return core->dropped(); }
+    /**
+     * runs the backend on the calling thread until the sink is destroyed, for sinks made with AsyncOptions::own_thread = false.
+     * The thread's placement is up to the caller
+     */
+    void run()
+    {
+        // held until run() returns, which may be after the sink is gone if slog::shutdown left it stuck in the target
+        std::shared_ptr<detail::AsyncCore> running = core;
+        running->run();
+    }
+    /**
+     * forwards the records that are ready without waiting for more, for driving a sink made with AsyncOptions::own_thread = false from
+     * an event loop. Returns how many were forwarded; with priority_lanes that's at most one batch from one lane, so call it until it
+     * returns 0 to catch up. Returns 0 at once if run() is running
+     */
+    std::size_t poll() { return core->poll(); }
+    /**
+     * blocks until every record queued so far has been handed to the target, without waiting out the reorder window. Without
+     * own_thread, if nothing is in run() or poll(), the calling thread forwards them itself
+     */
+    void flush() override { core->flush_until(std::chrono::steady_clock::time_point::max()); }
+    /** like flush(), but gives up at deadline. Returns whether everything was forwarded */
+    bool flush_until(std::chrono::steady_clock::time_point deadline) { return core->flush_until(deadline); }
+    /**
+     * calls f(sev, ctx, msg, msg_size, fields) for each record queued in any AsyncSink and not yet forwarded, oldest first for each
+     * thread, without allocating, locking, writing to the queues or calling a target. It's meant for crash handlers, which can't count
+     * on the backend. The queues are read while other threads may be changing them: each has a version the walk checks before every
+     * record, so a queue in the middle of a change is skipped and one that changes during the walk is left where it got to, and it
+     * returns false if any were. What it can't rule out is a change that starts between the check and f finishing with the record,
+     * which may then come out garbled, or a queue freed in that window, which faults and so ends the crash handler early
+     */
+    template <typename F> static bool visit_all_queued(F &&f) { return detail::AsyncCore::visit_all_queued(f); }
+    /**
+     * drains the remaining records, reports any drops and joins the backend thread, or waits for run() to return. If slog::shutdown
+     * left the backend stuck in the target, it's given SLOG_SHUTDOWN_TIMEOUT_MS more to finish, then left running rather than hang.
+     * Once it comes unstuck it drops whatever is left instead of calling the target again
+     */
+    ~AsyncSink()
+    {
+        detail::remove_closeable(this);
+        core->destroy();
+    }
+};
+
+/** A sink that fans each record out to several child sinks, each with its own minimum severity on top of the child's own */
+class TeeSink : public Sink
+{
+public:
+    /** how a child receives its records */
+    enum class Dispatch
+    {
+        INLINE,  /**< called directly from the logging thread */
+        BACKEND, /**< called from a dedicated backend thread, so a slow child can't throttle the others */
+    };
+private:
+    struct Target
+    {
+        Sink *sink;  /**< what records go to: the child, or the AsyncSink in front of it */
+        Sink *child; /**< the sink as added, whose own minimum severity applies too */
+        Severity min_sev;
+        std::unique_ptr<AsyncSink> backend;
+    };
+    std::vector<Target> targets;
+public:
+    TeeSink() = default;
+    TeeSink(const TeeSink &) = delete;
+    TeeSink &operator=(const TeeSink &) = delete;
+    /** adds a child sink. Children must be added before logging starts and must outlive the TeeSink */
+    TeeSink &add(Sink &sink, Severity min_sev = Severity::DEBUG, Dispatch dispatch = Dispatch::INLINE)
+    {
+        Target t{&sink, &sink, min_sev, nullptr};
+        if (dispatch == Dispatch::BACKEND)
+        {
+            t.backend.reset(new AsyncSink(sink));
+            t.sink = t.backend.get();
+        }
+        targets.push_back(std::move(t));
+        return *this;
+    }
+    void record(Severity sev, const Context &ctx, const std::string &msg) override
+    {
+        for (Target &t : targets)
+        {
+            if (sev >= t.min_sev && detail::sink_enabled(*t.child, sev))
+            {
+                t.sink->record(sev, ctx, msg);
+            }
+        }
+    }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields) override
+    {
+        for (Target &t : targets)
+        {
+            if (sev >= t.min_sev && detail::sink_enabled(*t.child, sev))
+            {
+                t.sink->record_fields(sev, ctx, msg, fields);
+            }
+        }
+    }
+    /**
+     * flushes the inline children, and blocks until every child dispatched on a backend thread has been handed what was logged so
+     * far. Those children aren't flushed themselves, since their backend may be calling them
+     */
+    void flush() override
+    {
+        for (Target &t : targets)
+        {
+            t.sink->flush();
+        }
+    }
+};
+} // namespace slog
+#endif
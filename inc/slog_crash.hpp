@@ -0,0 +1,317 @@
+/**
+ * @file slog_crash.hpp
+ * @author saltyJeff (saltyJeff@users.noreply.github.com)
+ * @brief saltyLogger: writes out the records still queued in async sinks when the process dies of a fatal signal
+ * @license MIT
+ */
+#pragma once
+#ifndef SLOG_CRASH_HPP_
+#define SLOG_CRASH_HPP_
+#include "slog.hpp"
+#include "slog_async.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <initializer_list>
+#include <signal.h>
+#include <unistd.h>
+
+#ifndef SLOG_CRASH_BUFFER
+/** the size of the buffer the crash handler formats lines in. Longer lines are written out in pieces */
+#define SLOG_CRASH_BUFFER 4096
+#endif
+#ifndef SLOG_CRASH_STACK
+/** the size of the alternate stack the crash handler runs on, so it still runs when the thread that installed it overflows its stack */
+#define SLOG_CRASH_STACK 65536
+#endif
+
+namespace slog
+{
+namespace detail
+{
+/** formats lines into a fixed buffer and write(2)s them out, without calling anything that isn't async-signal-safe */
+class SafeWriter
+{
+private:
+    int fd = STDERR_FILENO;
+    std::size_t used = 0;
+    char buf[SLOG_CRASH_BUFFER];
+public:
+    void set_fd(int to) { fd = to; }
+    void flush()
+    {
+        const char *p = buf;
+        while (used > 0)
+        {
+            ssize_t n = ::write(fd, p, used);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            p += n;
+            used -= static_cast<std::size_t>(n);
+        }
+        used = 0;
+    }
+    SafeWriter &str(const char *s, std::size_t n)
+    {
+        while (n > 0)
+        {
+            if (used == sizeof(buf))
+            {
+                flush();
+            }
+            std::size_t take = n < sizeof(buf) - used ? n : sizeof(buf) - used;
+            std::memcpy(buf + used, s, take);
+            used += take;
+            s += take;
+            n -= take;
+        }
+        return *this;
+    }
+    SafeWriter &str(const char *s) { return str(s, std::strlen(s)); }
+    SafeWriter &chr(char c) { return str(&c, 1); }
+    /** v in decimal, zero padded to at least width digits */
+    SafeWriter &uint(unsigned long long v, int width = 1)
+    {
+        char digits[20];
+        int n = 0;
+        do
+        {
+            digits[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        for (; width > n; width--)
+        {
+            chr('0');
+        }
+        while (n > 0)
+        {
+            chr(digits[--n]);
+        }
+        return *this;
+    }
+    SafeWriter &sint(long long v)
+    {
+        if (v < 0)
+        {
+            chr('-');
+            return uint(0ULL - static_cast<unsigned long long>(v));
+        }
+        return uint(static_cast<unsigned long long>(v));
+    }
+    /** d with 6 decimals, or in scientific notation past 1e18. Only as exact as a crash report needs */
+    SafeWriter &dbl(double d)
+    {
+        if (d != d)
+        {
+            return str("nan");
+        }
+        if (d < 0)
+        {
+            chr('-');
+            d = -d;
+        }
+        if (d - d != 0)
+        {
+            return str("inf");
+        }
+        int exp = 0;
+        while (d >= 1e18)
+        {
+            d /= 10;
+            exp++;
+        }
+        unsigned long long whole = static_cast<unsigned long long>(d);
+        unsigned long long frac = static_cast<unsigned long long>((d - static_cast<double>(whole)) * 1e6 + 0.5);
+        if (frac >= 1000000)
+        {
+            whole++;
+            frac -= 1000000;
+        }
+        uint(whole).chr('.').uint(frac, 6);
+        if (exp != 0)
+        {
+            chr('e').uint(static_cast<unsigned long long>(exp));
+        }
+        return *this;
+    }
+    SafeWriter &value(const Field &f)
+    {
+        switch (f.type)
+        {
+        case Field::Type::INT: return sint(f.i);
+        case Field::Type::UINT: return uint(f.u);
+        case Field::Type::DOUBLE: return dbl(f.d);
+        case Field::Type::BOOL: return str(f.b ? "true" : "false");
+        default: return str(f.str.data, f.str.size);
+        }
+    }
+    /** t as UTC ISO 8601 with microseconds, worked out by hand as gmtime_r isn't async-signal-safe */
+    SafeWriter &time(std::chrono::time_point<std::chrono::system_clock> t)
+    {
+        long long us = static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count());
+        long long secs = us / 1000000 - (us % 1000000 < 0);
+        long long days = secs / 86400 - (secs % 86400 < 0);
+        long long sod = secs - days * 86400;
+        // days since 1970-01-01 to a civil date, by Howard Hinnant's days_from_civil inverse
+        long long z = days + 719468;
+        long long era = (z >= 0 ? z : z - 146096) / 146097;
+        long long doe = z - era * 146097;
+        long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        long long mp = (5 * doy + 2) / 153;
+        long long day = doy - (153 * mp + 2) / 5 + 1;
+        long long month = mp < 10 ? mp + 3 : mp - 9;
+        long long year = yoe + era * 400 + (month <= 2);
+        sint(year).chr('-').uint(static_cast<unsigned long long>(month), 2).chr('-').uint(static_cast<unsigned long long>(day), 2);
+        chr('T').uint(static_cast<unsigned long long>(sod / 3600), 2).chr(':').uint(static_cast<unsigned long long>(sod / 60 % 60), 2);
+        chr(':').uint(static_cast<unsigned long long>(sod % 60), 2).chr('.');
+        return uint(static_cast<unsigned long long>(us - secs * 1000000), 6).chr('Z');
+    }
+    /** a record as one line: time, severity, call site, message, then its fields and tags as key=value */
+    void record(Severity sev, const Context &ctx, const char *msg, std::size_t msg_size, const Fields &fields)
+    {
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+        time(ctx.time).chr('\t');
+#endif
+        str(severity_to_str(sev)).chr('\t');
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+        str(ctx.file_name).chr(':').uint(ctx.line).chr('\t');
+#endif
+        str(msg, msg_size);
+        for (const Field &f : fields)
+        {
+            chr(' ').str(f.key).chr('=').value(f);
+        }
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+        for (const Field &f : ctx.tags)
+        {
+            chr(' ').str(f.key).chr('=').value(f);
+        }
+#else
+        (void)ctx;
+#endif
+        chr('\n');
+    }
+};
+inline const char *signal_name(int sig)
+{
+    switch (sig)
+    {
+    case SIGSEGV: return "SIGSEGV";
+    case SIGBUS: return "SIGBUS";
+    case SIGFPE: return "SIGFPE";
+    case SIGILL: return "SIGILL";
+    case SIGABRT: return "SIGABRT";
+    case SIGTRAP: return "SIGTRAP";
+    case SIGSYS: return "SIGSYS";
+    case SIGTERM: return "SIGTERM";
+    default: return "a fatal signal";
+    }
+}
+/** everything the crash handler needs, set up ahead of time so the handler itself doesn't allocate */
+struct CrashHandler
+{
+    SafeWriter out;
+    std::atomic<int> entered{0};
+    bool installed[NSIG];
+    struct sigaction previous[NSIG];
+    char stack[SLOG_CRASH_STACK];
+};
+inline CrashHandler &crash_handler()
+{
+    static CrashHandler h;
+    return h;
+}
+inline void on_crash(int sig, siginfo_t *info, void *uctx)
+{
+    CrashHandler &h = crash_handler();
+    int saved_errno = errno;
+    if (h.entered.exchange(1) != 0)
+    {
+        // crashed again, while writing or in a previous handler that returned: give up and let the signal end the process
+        signal(sig, SIG_DFL);
+        raise(sig);
+        return;
+    }
+    h.out.str("slog: caught ").str(signal_name(sig)).str(", writing out the records still queued\n");
+    bool all = AsyncSink::visit_all_queued([&h](Severity sev, const Context &ctx, const char *msg, std::size_t size, const Fields &fields) {
+        h.out.record(sev, ctx, msg, size, fields);
+    });
+    h.out.str(all ? "slog: done\n" : "slog: done, but some queues were changing and have been cut short\n");
+    h.out.flush();
+    errno = saved_errno;
+    struct sigaction &prev = h.previous[sig];
+    if (prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN)
+    {
+        if ((prev.sa_flags & SA_SIGINFO) != 0)
+        {
+            prev.sa_sigaction(sig, info, uctx);
+        }
+        else
+        {
+            prev.sa_handler(sig);
+        }
+        return;
+    }
+    // put the default action back; the signal is blocked until we return, and then takes the process down as it would have
+    sigaction(sig, &prev, nullptr);
+    raise(sig);
+}
+} // namespace detail
+
+/**
+ * Installs a handler for fatal signals that writes a last message and every record still queued in an AsyncSink to fd, using only
+ * async-signal-safe calls and a buffer set aside now, then hands the signal on to whichever handler was installed before, or lets
+ * it end the process. The records are written as plain lines rather than sent to the sinks' targets, which aren't safe to call from
+ * a signal handler. The handler runs on an alternate stack on the calling thread; other threads need their own (see sigaltstack)
+ * for it to run when they overflow their stack
+ */
+inline void install_crash_handler(int fd = STDERR_FILENO, std::initializer_list<int> signals = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
+{
+    detail::CrashHandler &h = detail::crash_handler();
+    h.out.set_fd(fd);
+    stack_t current;
+    if (sigaltstack(nullptr, &current) == 0 && (current.ss_flags & SS_DISABLE) != 0)
+    {
+        stack_t alt;
+        alt.ss_sp = h.stack;
+        alt.ss_size = sizeof(h.stack);
+        alt.ss_flags = 0;
+        sigaltstack(&alt, nullptr);
+    }
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = detail::on_crash;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (int sig : signals)
+    {
+        if (sig > 0 && sig < NSIG && !h.installed[sig] && sigaction(sig, &action, &h.previous[sig]) == 0)
+        {
+            h.installed[sig] = true;
+        }
+    }
+}
+/** puts back the handlers install_crash_handler replaced */
+inline void uninstall_crash_handler()
+{
+    detail::CrashHandler &h = detail::crash_handler();
+    for (int sig = 1; sig < NSIG; sig++)
+    {
+        if (h.installed[sig])
+        {
+            sigaction(sig, &h.previous[sig], nullptr);
+            h.installed[sig] = false;
+        }
+    }
+}
+} // namespace slog
+#endif
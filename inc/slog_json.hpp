@@ -0,0 +1,232 @@
+/**
+ * @file slog_json.hpp
+ * @author saltyJeff (saltyJeff@users.noreply.github.com)
+ * @brief saltyLogger: a sink that writes one JSON object per record
+ * @license MIT
+ */
+#pragma once
+#ifndef SLOG_JSON_HPP_
+#define SLOG_JSON_HPP_
+#include "slog.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+/** sets whether JSON string escaping scans with SIMD (SSE2/AVX2, whichever the compiler targets) */
+#ifndef SLOG_JSON_SIMD
+#define SLOG_JSON_SIMD 1
+#endif
+#if SLOG_JSON_SIMD == 1 && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+namespace slog
+{
+namespace detail
+{
+/** appends the JSON escape sequence for a byte that can't appear raw in a JSON string */
+inline void append_json_escape(std::string &out, unsigned char c)
+{
+    static const char hex[] = "0123456789abcdef";
+    switch (c)
+    {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\b': out += "\\b"; break;
+    case '\f': out += "\\f"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+        char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+        out.append(u, sizeof(u));
+    }
+}
+inline bool json_needs_escape(unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; }
+/** appends s escaped for use inside a JSON string, one byte at a time */
+inline void append_json_escaped_scalar(std::string &out, const char *s, std::size_t n)
+{
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (json_needs_escape(c))
+        {
+            out.append(s + run, i - run);
+            append_json_escape(out, c);
+            run = i + 1;
+        }
+    }
+    out.append(s + run, n - run);
+}
+/** appends s escaped for use inside a JSON string, scanning 16 or 32 bytes at a time where possible */
+inline void append_json_escaped(std::string &out, const char *s, std::size_t n)
+{
+    std::size_t i = 0;
+#if SLOG_JSON_SIMD == 1 && defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i ctrl = _mm256_set1_epi8(0x1F);
+    while (i + 32 <= n)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        // max_epu8(v, 0x1F) == 0x1F exactly when v <= 0x1F as an unsigned byte
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash)),
+                                      _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(hit));
+        if (mask == 0)
+        {
+            out.append(s + i, 32);
+            i += 32;
+            continue;
+        }
+        std::size_t at = static_cast<std::size_t>(__builtin_ctz(mask));
+        out.append(s + i, at);
+        append_json_escape(out, static_cast<unsigned char>(s[i + at]));
+        i += at + 1;
+    }
+#endif
+#if SLOG_JSON_SIMD == 1 && defined(__SSE2__)
+    const __m128i quote16 = _mm_set1_epi8('"');
+    const __m128i slash16 = _mm_set1_epi8('\\');
+    const __m128i ctrl16 = _mm_set1_epi8(0x1F);
+    while (i + 16 <= n)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote16), _mm_cmpeq_epi8(v, slash16)),
+                                   _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl16), ctrl16));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+        if (mask == 0)
+        {
+            out.append(s + i, 16);
+            i += 16;
+            continue;
+        }
+        std::size_t at = static_cast<std::size_t>(__builtin_ctz(mask));
+        out.append(s + i, at);
+        append_json_escape(out, static_cast<unsigned char>(s[i + at]));
+        i += at + 1;
+    }
+#endif
+    append_json_escaped_scalar(out, s + i, n - i);
+}
+/** appends a quoted, escaped JSON string */
+inline void append_json_string(std::string &out, const char *s, std::size_t n)
+{
+    out += '"';
+    append_json_escaped(out, s, n);
+    out += '"';
+}
+/** appends "key":value for a field */
+inline void append_json_member(std::string &out, const Field &f)
+{
+    append_json_string(out, f.key, std::strlen(f.key));
+    out += ':';
+    if (f.type == Field::Type::STRING)
+    {
+        append_json_string(out, f.str.data, f.str.size);
+    }
+    else if (f.type == Field::Type::DOUBLE && !std::isfinite(f.d))
+    {
+        out += "null";
+    }
+    else
+    {
+        append_field_value(out, f);
+    }
+}
+/** appends the tags as comma separated members, outermost first */
+inline void append_json_tags(std::string &out, const TagFrame *frame)
+{
+    if (frame->parent != nullptr)
+    {
+        append_json_tags(out, frame->parent);
+        out += ',';
+    }
+    append_json_member(out, frame->field);
+}
+} // namespace detail
+
+/** An implementation of the sink that writes each record as a single line JSON object to a FILE* */
+class JsonSink : public Sink
+{
+private:
+    std::FILE *file;
+    bool close_dtor;
+public:
+    JsonSink(std::FILE *file = stderr, bool close_dtor = false) : file(file), close_dtor(close_dtor) {};
+    /** appends the JSON object for a record, without a trailing newline. Fields are nested under "fields", ScopedTags under "tags" */
+    static void render(std::string &out, Severity sev, const Context &ctx, const std::string &msg, const Fields &fields = Fields())
+    {
+        out += '{';
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+        static const detail::TimeSpec time_spec("%Y-%m-%dT%H:%M:%S.%f%z");
+        out += "\"time\":\"";
+        detail::append_time(out, time_spec, ctx.time);
+        out += "\",";
+#endif
+        out += "\"sev\":\"";
+        out += severity_to_str(sev);
+        out += '"';
+#if (SLOG_CTX_MASK & SLOG_CTX_SRC) != 0
+        out += ",\"file\":";
+        detail::append_json_string(out, ctx.file_name, std::strlen(ctx.file_name));
+        out += ",\"line\":";
+        detail::append_uint(out, ctx.line);
+        out += ",\"func\":";
+        detail::append_json_string(out, ctx.func_name, std::strlen(ctx.func_name));
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+        out += ",\"tid\":";
+        detail::append_uint(out, std::hash<std::thread::id>()(ctx.thread_id));
+#endif
+#if (SLOG_CTX_MASK & SLOG_CTX_SEQ) != 0
+        out += ",\"seq\":";
+        detail::append_uint(out, ctx.seq);
+#endif
+        out += ",\"msg\":";
+        detail::append_json_string(out, msg.data(), msg.size());
+        if (!fields.empty())
+        {
+            out += ",\"fields\":{";
+            for (const Field &f : fields)
+            {
+                if (&f != fields.begin())
+                {
+                    out += ',';
+                }
+                detail::append_json_member(out, f);
+            }
+            out += '}';
+        }
+#if (SLOG_CTX_MASK & SLOG_CTX_TAGS) != 0
+        if (!ctx.tags.empty())
+        {
+            out += ",\"tags\":{";
+            detail::append_json_tags(out, ctx.tags.innermost());
+            out += '}';
+        }
+#endif
+        out += '}';
+    }
+    void record(Severity sev, const Context &ctx, const std::string &msg) override { record_fields(sev, ctx, msg, Fields()); }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields) override
+    {
+        static thread_local std::string line;
+        line.clear();
+        render(line, sev, ctx, msg, fields);
+        line += '\n';
+        std::fwrite(line.data(), 1, line.size(), file);
+    }
+    void flush() override { std::fflush(file); }
+    ~JsonSink()
+    {
+        if (close_dtor)
+        {
+            fclose(file);
+        }
+    }
+};
+} // namespace slog
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file slog_metrics.hpp
+ * @author saltyJeff (saltyJeff@users.noreply.github.com)
+ * @brief saltyLogger: periodically logs the logger's own metrics
+ * @license MIT
+ */
+#pragma once
+#ifndef SLOG_METRICS_HPP_
+#define SLOG_METRICS_HPP_
+#include "slog.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace slog
+{
+/** Logs what changed in slog::metrics_snapshot() to a sink every period, from a background thread */
+class MetricsReporter : private detail::Closeable
+{
+private:
+    Sink &sink;
+    std::chrono::milliseconds period;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stop = false;
+    bool held = false;    /**< before_fork got hold of mtx in time */
+    bool restart = false; /**< the child still has to start its thread */
+    std::thread worker;
+    void run()
+    {
+        Metrics last = metrics_snapshot();
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!wake.wait_for(lock, period, [this] { return stop; }))
+        {
+            Metrics now = metrics_snapshot();
+            report(now.since(last));
+            last = now;
+        }
+    }
+    /** for slog::shutdown: stops reporting */
+    bool close(std::chrono::steady_clock::time_point) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        wake.notify_one();
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+        return true;
+    }
+    /** waits out a report in progress and keeps the next one from starting until after the fork, unless the sink keeps it too long */
+    void before_fork() override
+    {
+        std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+        held = detail::lock_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(SLOG_FORK_TIMEOUT_MS));
+        lock.release();
+    }
+    void after_fork(bool child) override
+    {
+        if (child)
+        {
+            // the thread isn't there to join, or to unlock mtx if it was stuck with it, and the condition variable may still count it
+            // as waiting
+            new (&wake) std::condition_variable();
+            new (&worker) std::thread();
+            if (!held)
+            {
+                new (&mtx) std::mutex();
+            }
+            restart = true;
+        }
+        if (held)
+        {
+            mtx.unlock();
+        }
+    }
+    void start_in_child() override
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (restart && !stop)
+        {
+            worker = std::thread(&MetricsReporter::run, this);
+        }
+        restart = false;
+    }
+public:
+    MetricsReporter(Sink &sink, std::chrono::milliseconds period) : sink(sink), period(period), worker(&MetricsReporter::run, this)
+    {
+        detail::add_closeable(this);
+    };
+    MetricsReporter(const MetricsReporter &) = delete;
+    MetricsReporter &operator=(const MetricsReporter &) = delete;
+    /** logs one set of metrics, normally the change over the last period */
+    void report(const Metrics &m)
+    {
+        SLOG_KV(INFO, sink, "slog metrics", "records", m.total(), "debug", m.records[0], "info", m.records[1], "warn", m.records[2], "error",
+                m.records[3], "bytes", m.bytes, "dropped", m.dropped, "queue_high_water", m.queue_high_water, "record_p50_ns",
+                m.record_ns_quantile(0.5), "record_p99_ns", m.record_ns_quantile(0.99));
+    }
+    ~MetricsReporter()
+    {
+        detail::remove_closeable(this);
+        close(std::chrono::steady_clock::time_point::max());
+    }
+};
+} // namespace slog
+#endif
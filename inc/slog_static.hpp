@@ -0,0 +1,146 @@
+/**
+ * @file slog_static.hpp
+ * @author saltyJeff (saltyJeff@users.noreply.github.com)
+ * @brief saltyLogger: sink pipelines composed at compile time, with no virtual calls between stages
+ * @license MIT
+ */
+#pragma once
+#ifndef SLOG_STATIC_HPP_
+#define SLOG_STATIC_HPP_
+#include "slog.hpp"
+
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Each stage is a StaticSink holding the next stage by value, so a chain such as
+ *   slog::MinSeverity<slog::Severity::INFO, slog::Format<slog::Pattern, slog::FileWriter>>
+ * is one concrete type whose record() inlines all the way down to the write. Chains can be passed to SLOG like any sink.
+ */
+namespace slog
+{
+namespace detail
+{
+/**
+ * false when A is a single argument of type T, so that a stage's forwarding constructor leaves copying and moving the stage to the
+ * implicit constructors rather than outbid them for non-const lvalues
+ */
+template <typename T, typename... A> struct not_self : std::true_type
+{
+};
+template <typename T, typename A> struct not_self<T, A> : std::integral_constant<bool, !std::is_same<typename std::decay<A>::type, T>::value>
+{
+};
+} // namespace detail
+/** passes on records at or above MIN */
+template <Severity MIN, typename Next> class MinSeverity : public StaticSink<MinSeverity<MIN, Next>>
+{
+public:
+    Next next;
+    template <typename... A, typename = typename std::enable_if<detail::not_self<MinSeverity, A...>::value>::type>
+    MinSeverity(A &&...args) : next(std::forward<A>(args)...) {};
+    void record(Severity sev, const Context &ctx, const std::string &msg)
+    {
+        if (sev >= MIN)
+        {
+            next.record(sev, ctx, msg);
+        }
+    }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        if (sev >= MIN)
+        {
+            next.record_fields(sev, ctx, msg, fields);
+        }
+    }
+};
+/** passes on records for which Pred::pass(sev, ctx) is true */
+template <typename Pred, typename Next> class Filter : public StaticSink<Filter<Pred, Next>>
+{
+public:
+    Next next;
+    template <typename... A, typename = typename std::enable_if<detail::not_self<Filter, A...>::value>::type>
+    Filter(A &&...args) : next(std::forward<A>(args)...) {};
+    void record(Severity sev, const Context &ctx, const std::string &msg)
+    {
+        if (Pred::pass(sev, ctx))
+        {
+            next.record(sev, ctx, msg);
+        }
+    }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        if (Pred::pass(sev, ctx))
+        {
+            next.record_fields(sev, ctx, msg, fields);
+        }
+    }
+};
+/** renders each record into a line with Layout (Pattern or StaticPattern) and hands it to Writer */
+template <typename Layout, typename Writer> class Format : public StaticSink<Format<Layout, Writer>>
+{
+public:
+    Layout layout;
+    Writer writer;
+    Format(Layout layout = Layout(), Writer writer = Writer()) : layout(std::move(layout)), writer(std::move(writer)) {};
+    void record(Severity sev, const Context &ctx, const std::string &msg)
+    {
+        static thread_local std::string line;
+        line.clear();
+        layout.render(line, sev, ctx, msg);
+        line += '\n';
+        writer.write(line.data(), line.size());
+    }
+};
+/** a writer for Format that goes to a FILE* */
+class FileWriter
+{
+private:
+    std::FILE *file;
+public:
+    FileWriter(std::FILE *file = stderr) : file(file) {};
+    void write(const char *data, std::size_t size) { std::fwrite(data, 1, size, file); }
+};
+/** sends each record to every stage in turn */
+template <typename... Sinks> class Fanout;
+template <> class Fanout<> : public StaticSink<Fanout<>>
+{
+public:
+    void record(Severity, const Context &, const std::string &) {}
+    void record_fields(Severity, const Context &, const std::string &, const Fields &) {}
+};
+template <typename First, typename... Rest> class Fanout<First, Rest...> : public StaticSink<Fanout<First, Rest...>>
+{
+public:
+    First first;
+    Fanout<Rest...> rest;
+    Fanout() = default;
+    template <typename F, typename... R, typename = typename std::enable_if<detail::not_self<Fanout, F, R...>::value>::type>
+    Fanout(F &&first, R &&...rest) : first(std::forward<F>(first)), rest(std::forward<R>(rest)...) {};
+    void record(Severity sev, const Context &ctx, const std::string &msg)
+    {
+        first.record(sev, ctx, msg);
+        rest.record(sev, ctx, msg);
+    }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        first.record_fields(sev, ctx, msg, fields);
+        rest.record_fields(sev, ctx, msg, fields);
+    }
+};
+/** ends a chain in an ordinary virtual Sink, e.g. to reuse an existing sink behind static filters */
+class SinkRef : public StaticSink<SinkRef>
+{
+private:
+    Sink *sink;
+public:
+    SinkRef(Sink &sink) : sink(&sink) {};
+    void record(Severity sev, const Context &ctx, const std::string &msg) { sink->record(sev, ctx, msg); }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields)
+    {
+        sink->record_fields(sev, ctx, msg, fields);
+    }
+};
+} // namespace slog
+#endif
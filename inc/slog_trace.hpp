@@ -0,0 +1,214 @@
+/**
+ * @file slog_trace.hpp
+ * @author saltyJeff (saltyJeff@users.noreply.github.com)
+ * @brief saltyLogger: span and instant trace events, and a sink writing Chrome trace event JSON (loads in Perfetto)
+ * @license MIT
+ */
+#pragma once
+#ifndef SLOG_TRACE_HPP_
+#define SLOG_TRACE_HPP_
+#include "slog.hpp"
+#include "slog_json.hpp"
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <unistd.h>
+
+namespace slog
+{
+namespace detail
+{
+/** the key of the field marking a record as a trace event. Sinks recognise it by address, so a user field named "trace" isn't mistaken for it */
+inline const char *trace_key()
+{
+    static const char key[] = "trace";
+    return key;
+}
+template <typename S, typename... KV>
+inline typename if_sink<S, void>::type instant_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev, S &sink,
+                                                    const char *name, const KV &...kv)
+{
+    log_kv_impl(file_name, line, func_name, sev, sink, name, trace_key(), "instant", kv...);
+}
+template <typename... KV>
+inline void instant_impl(const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *name, const KV &...kv)
+{
+    log_kv_impl(file_name, line, func_name, sev, DEFAULT_SINK(), name, trace_key(), "instant", kv...);
+}
+} // namespace detail
+
+/** Logs a begin event when made and an end event when destroyed, both carrying a trace field. Made by SLOG_SPAN */
+template <typename S> class Span
+{
+private:
+    S *sink; /**< null when the severity is filtered out */
+    const char *file_name;
+    unsigned int line;
+    const char *func_name;
+    Severity sev;
+    const char *name;
+public:
+    Span(S *sink, const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *name)
+        : sink(sink), file_name(file_name), line(line), func_name(func_name), sev(sev), name(name)
+    {
+        if (sink != nullptr)
+        {
+            log_kv_impl(file_name, line, func_name, sev, *sink, name, detail::trace_key(), "begin");
+        }
+    }
+    Span(Span &&other)
+        : sink(other.sink), file_name(other.file_name), line(other.line), func_name(other.func_name), sev(other.sev), name(other.name)
+    {
+        other.sink = nullptr;
+    }
+    ~Span()
+    {
+        if (sink != nullptr)
+        {
+            log_kv_impl(file_name, line, func_name, sev, *sink, name, detail::trace_key(), "end");
+        }
+    }
+};
+namespace detail
+{
+inline Span<Sink> span(bool on, const char *file_name, unsigned int line, const char *func_name, Severity sev, const char *name)
+{
+    return Span<Sink>(on ? &DEFAULT_SINK() : nullptr, file_name, line, func_name, sev, name);
+}
+template <typename S>
+inline typename if_sink<S, Span<typename sink_target<S>::type>>::type span(bool on, const char *file_name, unsigned int line, const char *func_name,
+                                                                           Severity sev, const char *name, S &sink)
+{
+    return Span<typename sink_target<S>::type>(on ? &sink : nullptr, file_name, line, func_name, sev, name);
+}
+} // namespace detail
+
+/**
+ * An implementation of the sink that writes Chrome trace event JSON to a FILE*. Spans become begin/end events, instants and plain
+ * records become instant events, and each Context::thread_id gets its own track
+ */
+class TraceSink : public Sink, private detail::Closeable
+{
+private:
+    std::FILE *file;
+    bool close_dtor;
+    unsigned long long pid; /**< looked up once, and again in the child of a fork */
+    std::mutex mtx;
+    bool first = true;
+    std::map<std::thread::id, unsigned long long> tids;
+    unsigned long long tid_of(const Context &ctx)
+    {
+#if (SLOG_CTX_MASK & SLOG_CTX_THREAD) != 0
+        std::map<std::thread::id, unsigned long long>::iterator it = tids.find(ctx.thread_id);
+        if (it == tids.end())
+        {
+            it = tids.insert(std::make_pair(ctx.thread_id, static_cast<unsigned long long>(tids.size() + 1))).first;
+        }
+        return it->second;
+#else
+        (void)ctx;
+        return 1;
+#endif
+    }
+    /** for slog::shutdown: writes out what's buffered, leaving the array open for records logged after it */
+    bool close(std::chrono::steady_clock::time_point) override
+    {
+        flush();
+        return true;
+    }
+    /** keeps an event from being half written when the child gets its copy of the file's buffer */
+    void before_fork() override { mtx.lock(); }
+    void after_fork(bool child) override
+    {
+        if (child)
+        {
+            pid = static_cast<unsigned long long>(::getpid());
+        }
+        mtx.unlock();
+    }
+    void start_in_child() override {}
+public:
+    TraceSink(std::FILE *file, bool close_dtor = false)
+        : file(file), close_dtor(close_dtor), pid(static_cast<unsigned long long>(::getpid()))
+    {
+        std::fputs("[", file);
+        detail::add_closeable(this);
+    };
+    void record(Severity sev, const Context &ctx, const std::string &msg) override { record_fields(sev, ctx, msg, Fields()); }
+    void record_fields(Severity sev, const Context &ctx, const std::string &msg, const Fields &fields) override
+    {
+        static thread_local std::string event;
+        event.assign("{\"name\":");
+        detail::append_json_string(event, msg.data(), msg.size());
+        event += ",\"cat\":\"";
+        event += severity_to_str(sev);
+        event += "\",\"ph\":\"";
+        const char *ph = "i\",\"s\":\"t";
+        for (const Field &f : fields)
+        {
+            if (f.key == detail::trace_key() && f.type == Field::Type::STRING && f.str.size > 0)
+            {
+                ph = f.str.data[0] == 'b' ? "B" : f.str.data[0] == 'e' ? "E" : ph;
+            }
+        }
+        event += ph;
+        event += "\",\"ts\":";
+#if (SLOG_CTX_MASK & SLOG_CTX_TIME) != 0
+        detail::append_uint(event, static_cast<unsigned long long>(
+                                       std::chrono::duration_cast<std::chrono::microseconds>(ctx.time.time_since_epoch()).count()));
+#else
+        event += '0';
+#endif
+        event += ",\"pid\":";
+        detail::append_uint(event, pid);
+        event += ",\"args\":{";
+        bool first_arg = true;
+        for (const Field &f : fields)
+        {
+            if (f.key == detail::trace_key())
+            {
+                continue;
+            }
+            event += first_arg ? "" : ",";
+            first_arg = false;
+            detail::append_json_member(event, f);
+        }
+        event += "},\"tid\":";
+        std::lock_guard<std::mutex> lock(mtx);
+        detail::append_uint(event, tid_of(ctx));
+        event += '}';
+        std::fputs(first ? "\n" : ",\n", file);
+        first = false;
+        std::fwrite(event.data(), 1, event.size(), file);
+    }
+    void flush() override
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::fflush(file);
+    }
+    /** closes the JSON array */
+    ~TraceSink()
+    {
+        detail::remove_closeable(this);
+        std::fputs("\n]\n", file);
+        if (close_dtor)
+        {
+            fclose(file);
+        }
+        else
+        {
+            fflush(file);
+        }
+    }
+};
+} // namespace slog
+// clang-format off
+/** logs a begin trace event now and an end event when the enclosing scope exits, optionally to a given sink */
+#define SLOG_SPAN(SEV, NAME, ...) auto SLOG_CONCAT(slog_span_, __LINE__) = slog::detail::span( \
+    !SLOG_FILTERED_(SEV), __FILE__, __LINE__, __FUNCTION__, slog::Severity::SEV, NAME, ##__VA_ARGS__)
+/** logs an instant trace event, with optional key, value fields like SLOG_KV: SLOG_INSTANT(INFO, [sink,] "name", "key", value...) */
+#define SLOG_INSTANT(SEV, ...) if(SLOG_LIKELY(SLOG_FILTERED_(SEV))){;} else SLOG_COLD_BRANCH \
+    slog::detail::instant_impl(__FILE__, __LINE__, __FUNCTION__, slog::Severity::SEV, __VA_ARGS__)
+// clang-format on
+#endif
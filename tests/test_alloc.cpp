@@ -0,0 +1,159 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <slog_async.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+// every allocation in the process goes through these, so a log call can be bracketed and its allocations counted
+static std::atomic<long> allocations{0};
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+class NullSink : public slog::Sink
+{
+public:
+    void record(slog::Severity, const slog::Context &, const std::string &) override {}
+    void record_fields(slog::Severity, const slog::Context &, const std::string &, const slog::Fields &) override {}
+};
+
+/** runs f once to warm the per-thread buffers, then returns how many allocations a second run made */
+template <typename F> long allocations_per_call(F f)
+{
+    f();
+    long before = allocations.load();
+    f();
+    return allocations.load() - before;
+}
+
+TEST_CASE("C string messages don't allocate")
+{
+    NullSink sink;
+    CHECK_EQ(allocations_per_call([&] { SLOG(INFO, sink, "a literal message well past the small string optimisation"); }), 0);
+}
+
+TEST_CASE("stream-style messages don't allocate")
+{
+    NullSink sink;
+    CHECK_EQ(allocations_per_call([&] { SLOG(INFO, sink) << "value " << 42 << ' ' << 2.5 << " and a long enough tail to leave SSO"; }), 0);
+}
+
+TEST_CASE("key-value messages don't allocate")
+{
+    NullSink sink;
+    std::string tenant = "a tenant name long enough to leave SSO";
+    CHECK_EQ(allocations_per_call([&] { SLOG_KV(INFO, sink, "request done", "latency_us", 12, "tenant", tenant); }), 0);
+}
+
+TEST_CASE("the logfmt fallback for key-value messages doesn't allocate")
+{
+    // only overrides record, so the fields are rendered into the message by Sink::record_fields
+    class TextSink : public slog::Sink
+    {
+    public:
+        void record(slog::Severity, const slog::Context &, const std::string &) override {}
+    } sink;
+    std::string tenant = "a tenant name long enough to leave SSO";
+    CHECK_EQ(allocations_per_call([&] { SLOG_KV(INFO, sink, "request done", "latency_us", 12, "tenant", tenant); }), 0);
+}
+
+#if SLOG_FMT > 0
+TEST_CASE("fmt-style messages don't allocate")
+{
+    NullSink sink;
+    CHECK_EQ(allocations_per_call([&] { SLOG(INFO, sink, "formatted {} {} and a long enough tail to leave SSO", 42, 2.5); }), 0);
+}
+#endif
+
+TEST_CASE("file sinks don't allocate")
+{
+    std::FILE *dev_null = std::fopen("/dev/null", "w");
+    REQUIRE(dev_null != nullptr);
+    slog::FileSink sink(dev_null, true, "{time:%H:%M:%S.%f} {sev} {tid} {file}:{line} {msg}");
+    CHECK_EQ(allocations_per_call([&] { SLOG(INFO, sink) << "value " << 42 << " and a long enough tail to leave SSO"; }), 0);
+}
+
+TEST_CASE("scoped tags don't allocate")
+{
+    NullSink sink;
+    CHECK_EQ(allocations_per_call([&] {
+                 slog::ScopedTag req("req", 42);
+                 slog::ScopedTag tenant("tenant", "a tenant name past the small string optimisation");
+                 SLOG(INFO, sink, "tagged");
+             }),
+             0);
+}
+
+TEST_CASE("async sinks don't allocate per record")
+{
+    NullSink target;
+    slog::AsyncSink async(target);
+    std::string tenant = "a tenant name long enough to leave SSO";
+    CHECK_EQ(allocations_per_call([&] {
+                 for (int i = 0; i < 100; i++)
+                 {
+                     SLOG(INFO, async, "a literal message well past the small string optimisation");
+                     SLOG_KV(INFO, async, "request done", "latency_us", i, "tenant", tenant);
+                 }
+                 async.flush();
+             }),
+             0);
+}
+
+TEST_CASE("threads logging to many async sinks keep their buffer in each")
+{
+    // more sinks than a small fixed cache would hold. Each thread's records wake the backends, which collect any buffer no thread
+    // holds on to, so a thread that let go of its buffer would have to make a new one when it next logs there
+    const int n = 6;
+    NullSink target;
+    std::vector<std::unique_ptr<slog::AsyncSink>> sinks;
+    for (int i = 0; i < n; i++)
+    {
+        sinks.emplace_back(new slog::AsyncSink(target));
+    }
+    auto round = [&sinks] {
+        for (std::unique_ptr<slog::AsyncSink> &async : sinks)
+        {
+            SLOG(INFO, *async, "a literal message well past the small string optimisation");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    std::atomic<bool> done{false};
+    std::atomic<int> rounds{0};
+    std::thread other([&] {
+        while (!done.load())
+        {
+            round();
+            rounds++;
+        }
+    });
+    // so its first buffers are made before anything is counted
+    while (rounds.load() == 0)
+    {
+        std::this_thread::yield();
+    }
+    CHECK_EQ(allocations_per_call([&] {
+                 for (int i = 0; i < 50; i++)
+                 {
+                     round();
+                 }
+             }),
+             0);
+    done = true;
+    other.join();
+}
@@ -0,0 +1,811 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <algorithm>
+#include <slog_async.hpp>
+#if SLOG_ATFORK == 1
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+TEST_CASE("tee filters each child by its own severity")
+{
+    MockSink all, errors;
+    slog::TeeSink tee;
+    tee.add(all).add(errors, slog::Severity::ERROR);
+    SLOG(INFO, tee, "info");
+    SLOG(ERROR, tee, "error");
+    REQUIRE_EQ(all.records.size(), 2);
+    REQUIRE_EQ(errors.records.size(), 1);
+    CHECK_EQ(errors.records[0].msg, "error");
+}
+
+TEST_CASE("tee respects each child's own minimum severity")
+{
+    MockSink inline_child, backend_child;
+    inline_child.set_min_severity(slog::Severity::WARN);
+    backend_child.set_min_severity(slog::Severity::WARN);
+    slog::TeeSink tee;
+    tee.add(inline_child).add(backend_child, slog::Severity::DEBUG, slog::TeeSink::Dispatch::BACKEND);
+    SLOG(INFO, tee, "info");
+    SLOG_KV(INFO, tee, "info", "k", 1);
+    SLOG(WARN, tee, "warn");
+    tee.flush();
+    REQUIRE_EQ(inline_child.records.size(), 1);
+    CHECK_EQ(inline_child.records[0].msg, "warn");
+    REQUIRE_EQ(backend_child.records.size(), 1);
+    CHECK_EQ(backend_child.records[0].msg, "warn");
+}
+
+TEST_CASE("tee hands backend children off to another thread")
+{
+    MockSink slow;
+    slog::TeeSink tee;
+    tee.add(slow, slog::Severity::WARN, slog::TeeSink::Dispatch::BACKEND);
+    for (int i = 0; i < 100; i++)
+    {
+        SLOG(WARN, tee) << i;
+    }
+    SLOG(DEBUG, tee, "filtered");
+    tee.flush();
+    REQUIRE_EQ(slow.records.size(), 100);
+    CHECK_EQ(slow.records.front().msg, "0");
+    CHECK_EQ(slow.records.back().msg, "99");
+}
+
+struct FieldSink : public slog::Sink
+{
+    std::vector<std::string> lines;
+    void record(slog::Severity, const slog::Context &, const std::string &msg) override { lines.push_back(msg); }
+    void record_fields(slog::Severity, const slog::Context &, const std::string &msg, const slog::Fields &fields) override
+    {
+        std::string line = msg;
+        for (const slog::Field &f : fields)
+        {
+            line += std::string("|") + f.key + ":";
+            slog::detail::append_field_value(line, f);
+        }
+        lines.push_back(line);
+    }
+};
+
+TEST_CASE("async sinks keep their own copy of string fields")
+{
+    FieldSink fields;
+    slog::AsyncSink async(fields);
+    {
+        std::string tenant = "acme";
+        SLOG_KV(INFO, async, "req", "tenant", tenant, "shard", 7);
+        tenant = "clobbered";
+    }
+    async.flush();
+    REQUIRE_EQ(fields.lines.size(), 1);
+    CHECK_EQ(fields.lines[0], "req|tenant:acme|shard:7");
+}
+
+struct CtxSink : public FieldSink
+{
+    std::vector<slog::Context> ctxs;
+    void record_fields(slog::Severity sev, const slog::Context &ctx, const std::string &msg, const slog::Fields &fields) override
+    {
+        ctxs.push_back(ctx);
+        FieldSink::record_fields(sev, ctx, msg, fields);
+    }
+};
+
+TEST_CASE("async records give back the context they were made with, even one made on another thread")
+{
+    CtxSink out;
+    slog::AsyncSink async(out);
+    slog::Context mine = slog::make_ctx("foo.cpp", 42, "bar");
+    slog::Context theirs;
+    std::thread([&theirs]() { theirs = slog::make_ctx("baz.cpp", 7, "qux"); }).join();
+    slog::Field n = slog::detail::make_field("n", 1);
+    slog::Field str = slog::detail::make_field("s", "x");
+    async.record_fields(slog::Severity::WARN, mine, "mine", slog::Fields(&n, 1));
+    async.record_fields(slog::Severity::WARN, theirs, "theirs", slog::Fields(&str, 1));
+    async.flush();
+    REQUIRE_EQ(out.ctxs.size(), 2);
+    CHECK_EQ(out.lines[0], "mine|n:1");
+    CHECK_EQ(out.lines[1], "theirs|s:x");
+    CHECK_EQ(std::string(out.ctxs[0].file_name), "foo.cpp");
+    CHECK_EQ(out.ctxs[0].line, 42);
+    CHECK_EQ(std::string(out.ctxs[1].func_name), "qux");
+    CHECK_EQ(out.ctxs[0].thread_id, std::this_thread::get_id());
+    CHECK_EQ(out.ctxs[1].thread_id, theirs.thread_id);
+    CHECK_NE(out.ctxs[1].thread_id, std::this_thread::get_id());
+    CHECK_EQ(out.ctxs[0].seq, mine.seq);
+    CHECK(out.ctxs[1].time == theirs.time);
+}
+
+struct GatedSink : public slog::Sink
+{
+    std::mutex gate;
+    std::atomic<int> entered{0};
+    std::vector<std::string> lines;
+    std::vector<unsigned long long> seqs;
+    void record(slog::Severity, const slog::Context &ctx, const std::string &msg) override
+    {
+        entered++;
+        std::lock_guard<std::mutex> lock(gate);
+        seqs.push_back(ctx.seq);
+        std::string line = msg;
+        slog::detail::append_tags(line, ctx.tags.innermost());
+        lines.push_back(line);
+    }
+};
+
+TEST_CASE("async sinks keep scoped tags alive until the record is written")
+{
+    GatedSink gated;
+    slog::AsyncSink async(gated);
+    gated.gate.lock();
+    {
+        slog::ScopedTag req("req", 7);
+        slog::ScopedTag tenant("tenant", "acme");
+        SLOG(INFO, async, "queued");
+    }
+    // reuse the frames the queued record may not hold on to
+    {
+        slog::ScopedTag other("other", 1);
+        SLOG(INFO, async, "second");
+    }
+    gated.gate.unlock();
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 2);
+    CHECK_EQ(gated.lines[0], "queued req=7 tenant=acme");
+    CHECK_EQ(gated.lines[1], "second other=1");
+}
+
+namespace
+{
+/** holds the backend inside the target with one record, so the next ones pile up in the queue */
+void stall(GatedSink &gated, slog::AsyncSink &async)
+{
+    gated.gate.lock();
+    SLOG(INFO, async, "stalled");
+    while (gated.entered.load() == 0)
+    {
+        std::this_thread::yield();
+    }
+}
+slog::AsyncOptions bounded(std::size_t capacity, slog::Overflow overflow)
+{
+    slog::AsyncOptions opt;
+    opt.capacity = capacity;
+    opt.overflow = overflow;
+    opt.drop_report_period = std::chrono::milliseconds(0);
+    return opt;
+}
+} // namespace
+
+TEST_CASE("async overflow can drop the newest records")
+{
+    GatedSink gated;
+    slog::AsyncSink async(gated, bounded(4, slog::Overflow::DROP_NEWEST));
+    stall(gated, async);
+    for (int i = 0; i < 10; i++)
+    {
+        SLOG(INFO, async) << i;
+    }
+    gated.gate.unlock();
+    async.flush();
+    CHECK_EQ(async.dropped(), 6);
+    CHECK_EQ(async.dropped(slog::Severity::INFO), 6);
+    // the drops are reported as soon as the backend gets past the stalled record
+    REQUIRE_EQ(gated.lines.size(), 6);
+    CHECK_EQ(gated.lines[1], "6 records dropped dropped=6");
+    CHECK_EQ(gated.lines[2], "0");
+    CHECK_EQ(gated.lines[5], "3");
+}
+
+TEST_CASE("async overflow can drop the oldest records")
+{
+    GatedSink gated;
+    slog::AsyncSink async(gated, bounded(4, slog::Overflow::DROP_OLDEST));
+    stall(gated, async);
+    for (int i = 0; i < 10; i++)
+    {
+        SLOG(INFO, async) << i;
+    }
+    gated.gate.unlock();
+    async.flush();
+    CHECK_EQ(async.dropped(), 6);
+    REQUIRE_EQ(gated.lines.size(), 6);
+    CHECK_EQ(gated.lines[2], "6");
+    CHECK_EQ(gated.lines[5], "9");
+}
+
+TEST_CASE("async overflow can drop by severity but never drops errors")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt = bounded(2, slog::Overflow::DROP_BELOW);
+    opt.drop_below = slog::Severity::WARN;
+    slog::AsyncSink async(gated, opt);
+    stall(gated, async);
+    SLOG(INFO, async, "info 0");
+    SLOG(INFO, async, "info 1");
+    SLOG(INFO, async, "info 2");
+    SLOG(ERROR, async, "error");
+    SLOG(WARN, async, "warn");
+    gated.gate.unlock();
+    async.flush();
+    CHECK_EQ(async.dropped(slog::Severity::INFO), 1);
+    CHECK_EQ(async.dropped(), 1);
+    REQUIRE_EQ(gated.lines.size(), 6);
+    CHECK_EQ(gated.lines[1], "1 record dropped dropped=1");
+    CHECK_EQ(gated.lines[4], "error");
+    CHECK_EQ(gated.lines[5], "warn");
+}
+
+TEST_CASE("async overflow can block for a bounded time")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt = bounded(1, slog::Overflow::BLOCK);
+    opt.block_timeout = std::chrono::milliseconds(20);
+    slog::AsyncSink async(gated, opt);
+    stall(gated, async);
+    SLOG(INFO, async, "queued");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SLOG(INFO, async, "timed out");
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+    CHECK_EQ(async.dropped(), 1);
+    gated.gate.unlock();
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 3);
+    CHECK_EQ(gated.lines[2], "queued");
+}
+
+TEST_CASE("priority lanes forward the most severe records first")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt;
+    opt.priority_lanes = true;
+    slog::AsyncSink async(gated, opt);
+    stall(gated, async);
+    for (int i = 0; i < 200; i++)
+    {
+        SLOG(DEBUG, async) << "debug " << i;
+    }
+    SLOG(INFO, async, "info");
+    SLOG(ERROR, async, "error");
+    gated.gate.unlock();
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 203);
+    CHECK_EQ(gated.lines[1], "error");
+    CHECK_EQ(gated.lines[2], "info");
+    CHECK_EQ(gated.lines[3], "debug 0");
+    CHECK_EQ(gated.lines[202], "debug 199");
+    // sequence numbers put them back in the order they were logged
+    std::vector<std::size_t> order(gated.lines.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return gated.seqs[a] < gated.seqs[b]; });
+    CHECK_EQ(gated.lines[order[201]], "info");
+    CHECK_EQ(gated.lines[order[202]], "error");
+}
+
+TEST_CASE("priority lanes are bounded separately")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt = bounded(2, slog::Overflow::DROP_NEWEST);
+    opt.priority_lanes = true;
+    slog::AsyncSink async(gated, opt);
+    stall(gated, async);
+    for (int i = 0; i < 5; i++)
+    {
+        SLOG(DEBUG, async, "debug");
+    }
+    SLOG(ERROR, async, "error");
+    gated.gate.unlock();
+    async.flush();
+    CHECK_EQ(async.dropped(slog::Severity::DEBUG), 3);
+    CHECK_EQ(async.dropped(slog::Severity::ERROR), 0);
+}
+
+namespace
+{
+/** logs msg with a made up Context::time, ms after the epoch */
+void record_at(slog::Sink &sink, long ms, const char *msg)
+{
+    slog::Context ctx = slog::make_ctx(__FILE__, __LINE__, __FUNCTION__);
+    ctx.time = std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+    sink.record(slog::Severity::INFO, ctx, msg);
+}
+} // namespace
+
+TEST_CASE("async sinks merge each thread's records by time")
+{
+    GatedSink gated;
+    slog::AsyncSink async(gated);
+    stall(gated, async);
+    std::thread odd([&] {
+        record_at(async, 1, "1");
+        record_at(async, 3, "3");
+        record_at(async, 5, "5");
+    });
+    std::thread even([&] {
+        record_at(async, 2, "2");
+        record_at(async, 4, "4");
+        record_at(async, 6, "6");
+    });
+    odd.join();
+    even.join();
+    gated.gate.unlock();
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 7);
+    for (int i = 1; i <= 6; i++)
+    {
+        CHECK_EQ(gated.lines[i], std::to_string(i));
+    }
+}
+
+TEST_CASE("the reorder window holds records back for earlier ones from other threads")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt;
+    opt.reorder_window = std::chrono::milliseconds(200);
+    slog::AsyncSink async(gated, opt);
+    slog::Context late = slog::make_ctx(__FILE__, __LINE__, __FUNCTION__);
+    async.record(slog::Severity::INFO, late, "late");
+    std::thread other([&] {
+        slog::Context early = slog::make_ctx(__FILE__, __LINE__, __FUNCTION__);
+        early.time -= std::chrono::milliseconds(100);
+        async.record(slog::Severity::INFO, early, "early");
+    });
+    other.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_EQ(gated.entered.load(), 0);
+    // both go once they've aged past the window, without a flush
+    while (gated.entered.load() < 2)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 2);
+    CHECK_EQ(gated.lines[0], "early");
+    CHECK_EQ(gated.lines[1], "late");
+}
+
+TEST_CASE("the reorder window holds records back for no longer than it lasts if the wall clock steps back")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt;
+    opt.reorder_window = std::chrono::milliseconds(20);
+    slog::AsyncSink async(gated, opt);
+    // stamped before the clock went back an hour, so the wall clock won't reach it for that long
+    slog::Context ahead = slog::make_ctx(__FILE__, __LINE__, __FUNCTION__);
+    ahead.time += std::chrono::hours(1);
+    async.record(slog::Severity::INFO, ahead, "ahead");
+    auto start = std::chrono::steady_clock::now();
+    while (gated.entered.load() < 1 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK_EQ(gated.entered.load(), 1);
+    CHECK(std::chrono::steady_clock::now() - start >= opt.reorder_window);
+    // and the window still holds back the records after it
+    SLOG(INFO, async, "after");
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK_EQ(gated.entered.load(), 1);
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 2);
+    CHECK_EQ(gated.lines[0], "ahead");
+}
+
+TEST_CASE("an idle backend parks and wakes up for the next record")
+{
+    GatedSink gated;
+    slog::AsyncOptions opt;
+    opt.idle_spin = std::chrono::microseconds(0);
+    opt.idle_yield = std::chrono::microseconds(0);
+    slog::AsyncSink async(gated, opt);
+    SLOG(INFO, async, "before");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    SLOG(INFO, async, "after");
+    // no flush: the record alone has to wake the backend
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (gated.entered.load() < 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK_EQ(gated.entered.load(), 2);
+}
+
+TEST_CASE("async sinks without a thread forward records when polled")
+{
+    FieldSink out;
+    slog::AsyncOptions opt;
+    opt.own_thread = false;
+    slog::AsyncSink async(out, opt);
+    SLOG(INFO, async, "one");
+    SLOG(INFO, async, "two");
+    CHECK(out.lines.empty());
+    CHECK_EQ(async.poll(), 2);
+    CHECK_EQ(async.poll(), 0);
+    SLOG(INFO, async, "three");
+    // with nothing running the backend, flush forwards them itself
+    async.flush();
+    REQUIRE_EQ(out.lines.size(), 3);
+    CHECK_EQ(out.lines[2], "three");
+}
+
+TEST_CASE("async sinks can run their backend on a caller's thread")
+{
+    GatedSink gated;
+    std::thread driver;
+    {
+        slog::AsyncOptions opt;
+        opt.own_thread = false;
+        slog::AsyncSink async(gated, opt);
+        driver = std::thread([&] { async.run(); });
+        for (int i = 0; i < 100; i++)
+        {
+            SLOG(INFO, async) << i;
+        }
+        // only run() can be forwarding them
+        while (gated.entered.load() < 100)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        SLOG(INFO, async, "last");
+    }
+    // the destructor waited for run() to forward everything and return
+    driver.join();
+    REQUIRE_EQ(gated.lines.size(), 101);
+    CHECK_EQ(gated.lines.back(), "last");
+}
+
+#ifdef __linux__
+struct PlacementSink : public slog::Sink
+{
+    std::string thread_name;
+    int cpu = -1;
+    void record(slog::Severity, const slog::Context &, const std::string &) override
+    {
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        thread_name = name;
+        cpu = sched_getcpu();
+    }
+};
+
+TEST_CASE("the async backend thread is named and pinned as asked")
+{
+    PlacementSink placed;
+    slog::AsyncOptions opt;
+    opt.cpus.push_back(0);
+    opt.thread_name = "log_backend";
+    slog::AsyncSink async(placed, opt);
+    SLOG(INFO, async, "where am I");
+    async.flush();
+    CHECK_EQ(placed.thread_name, "log_backend");
+    CHECK_EQ(placed.cpu, 0);
+}
+
+TEST_CASE("an async sink on a NUMA node runs its backend on that node's CPUs")
+{
+    std::vector<int> cpus = slog::detail::node_cpus(0);
+    if (cpus.empty())
+    {
+        return;
+    }
+    PlacementSink placed;
+    slog::AsyncOptions opt;
+    opt.node = 0;
+    slog::AsyncSink async(placed, opt);
+    SLOG(INFO, async, "where am I");
+    async.flush();
+    CHECK(std::find(cpus.begin(), cpus.end(), placed.cpu) != cpus.end());
+}
+#endif
+
+TEST_CASE("async sinks on huge pages carry records intact")
+{
+    FieldSink out;
+    slog::AsyncOptions opt;
+    opt.huge_pages = true;
+    opt.node = 0;
+    slog::AsyncSink async(out, opt);
+    for (int i = 0; i < 50000; i++)
+    {
+        SLOG_KV(INFO, async, "huge", "i", i);
+    }
+    async.flush();
+    REQUIRE_EQ(out.lines.size(), 50000);
+    CHECK_EQ(out.lines[0], "huge|i:0");
+    CHECK_EQ(out.lines[49999], "huge|i:49999");
+}
+
+/** the process's mapped memory, in pages */
+static long mapped_pages()
+{
+    long pages = 0;
+    std::FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (statm != nullptr)
+    {
+        if (std::fscanf(statm, "%ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        std::fclose(statm);
+    }
+    return pages;
+}
+
+struct DiscardSink : public slog::Sink
+{
+    void record(slog::Severity, const slog::Context &, const std::string &) override {}
+};
+
+TEST_CASE("destroying an async sink frees the rings its producers' caches still point to")
+{
+    long page = sysconf(_SC_PAGESIZE);
+    long before = mapped_pages();
+    {
+        DiscardSink discard;
+        slog::AsyncOptions opt;
+        opt.own_thread = false;
+        slog::AsyncSink async(discard, opt);
+        // with nothing forwarding them, this thread's ring grows to tens of MB
+        for (int i = 0; i < 200000; i++)
+        {
+            SLOG(INFO, async) << "a record long enough to take up a few slots " << i;
+        }
+        CHECK_GT((mapped_pages() - before) * page, 16L << 20);
+    }
+    // this thread's cache still holds its buffer, but the rings are gone
+    CHECK_LT((mapped_pages() - before) * page, 8L << 20);
+}
+
+TEST_CASE("async sinks carry messages of any length intact across ring wrap-arounds")
+{
+    FieldSink out;
+    slog::AsyncSink async(out);
+    std::vector<std::string> sent;
+    for (int i = 0; i < 2000; i++)
+    {
+        // from empty to several times the size of a ring
+        std::string msg(static_cast<std::size_t>(i % 7 == 0 ? i * 211 : i % 300), static_cast<char>('a' + i % 26));
+        SLOG_KV(INFO, async, msg.c_str(), "i", i, "copy", msg);
+        sent.push_back(msg + "|i:" + std::to_string(i) + "|copy:" + msg);
+    }
+    async.flush();
+    REQUIRE_EQ(out.lines.size(), sent.size());
+    for (std::size_t i = 0; i < sent.size(); i++)
+    {
+        CHECK(out.lines[i] == sent[i]);
+    }
+}
+
+TEST_CASE("dropping the oldest records keeps the newest while the backend is stuck")
+{
+    GatedSink gated;
+    slog::AsyncSink async(gated, bounded(4, slog::Overflow::DROP_OLDEST));
+    stall(gated, async);
+    for (int i = 0; i < 100000; i++)
+    {
+        SLOG(INFO, async) << "record " << i;
+    }
+    gated.gate.unlock();
+    async.flush();
+    CHECK_EQ(async.dropped(), 99996);
+    REQUIRE_EQ(gated.lines.size(), 6);
+    CHECK_EQ(gated.lines[2], "record 99996");
+    CHECK_EQ(gated.lines[5], "record 99999");
+}
+
+TEST_CASE("shutdown forwards what's queued, then has records forwarded as they're logged")
+{
+    FieldSink out;
+    slog::AsyncSink async(out);
+    for (int i = 0; i < 1000; i++)
+    {
+        SLOG(INFO, async) << "queued " << i;
+    }
+    CHECK(slog::shutdown(std::chrono::seconds(5)));
+    REQUIRE_EQ(out.lines.size(), 1000);
+    CHECK_EQ(out.lines[999], "queued 999");
+    SLOG(INFO, async, "after shutdown");
+    REQUIRE_EQ(out.lines.size(), 1001);
+    CHECK_EQ(out.lines[1000], "after shutdown");
+    async.flush();
+    CHECK(slog::shutdown(std::chrono::seconds(5)));
+}
+
+TEST_CASE("shutdown gives up on a stuck target at the deadline")
+{
+    GatedSink gated;
+    {
+        slog::AsyncSink async(gated);
+        stall(gated, async);
+        SLOG(INFO, async, "behind the stall");
+        auto start = std::chrono::steady_clock::now();
+        CHECK_FALSE(slog::shutdown(std::chrono::milliseconds(50)));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+        // once the target comes unstuck, the destructor waits for the backend it left behind
+        gated.gate.unlock();
+    }
+    REQUIRE_EQ(gated.lines.size(), 2);
+    CHECK_EQ(gated.lines[1], "behind the stall");
+}
+
+TEST_CASE("an async sink can be destroyed while shutdown's deadline left its backend stuck in the target")
+{
+    // outlives the backend, which is still inside it when the test ends
+    static GatedSink gated;
+    std::unique_ptr<slog::AsyncSink> async(new slog::AsyncSink(gated));
+    stall(gated, *async);
+    SLOG(INFO, *async, "dropped with the sink");
+    CHECK_FALSE(slog::shutdown(std::chrono::milliseconds(50)));
+    auto start = std::chrono::steady_clock::now();
+    async.reset();
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(SLOG_SHUTDOWN_TIMEOUT_MS));
+    // the backend comes unstuck with the sink gone: it keeps its own state alive and no longer calls the target
+    gated.gate.unlock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK_EQ(gated.entered.load(), 1);
+}
+
+#if SLOG_ATFORK == 1
+namespace
+{
+/** counts the records logged by the parent's threads and by a forked child apart */
+struct CountSink : public slog::Sink
+{
+    std::atomic<int> parent{0};
+    std::atomic<int> child{0};
+    void record(slog::Severity, const slog::Context &, const std::string &msg) override { (msg[0] == 'c' ? child : parent)++; }
+};
+/** waits for a forked child, killing it if it's still running after 10s. Returns whether it exited with 0 */
+bool reap(pid_t pid)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    int status = 0;
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+} // namespace
+
+TEST_CASE("async sinks keep working on both sides of a fork while other threads are logging")
+{
+    const int threads = 4;
+    const int per_thread = 20000;
+    CountSink counts;
+    slog::AsyncSink async(counts);
+    std::vector<std::thread> loggers;
+    for (int t = 0; t < threads; t++)
+    {
+        loggers.emplace_back([&async] {
+            for (int i = 0; i < per_thread; i++)
+            {
+                SLOG(INFO, async) << "p" << i;
+            }
+        });
+    }
+    for (int f = 0; f < 20; f++)
+    {
+        pid_t pid = fork();
+        REQUIRE_NE(pid, -1);
+        if (pid == 0)
+        {
+            // the child's copy of the backend must be running, and empty of the parent's records
+            for (int i = 0; i < 100; i++)
+            {
+                SLOG(INFO, async) << "c" << i;
+            }
+            async.flush();
+            _exit(counts.child.load() == 100 ? 0 : 1);
+        }
+        CHECK(reap(pid));
+    }
+    for (std::thread &t : loggers)
+    {
+        t.join();
+    }
+    async.flush();
+    CHECK_EQ(counts.parent.load(), threads * per_thread);
+    CHECK_EQ(counts.child.load(), 0);
+}
+
+TEST_CASE("async sinks can reopen their target in a forked child")
+{
+    int fds[2];
+    REQUIRE_EQ(pipe(fds), 0);
+    slog::FileSink file(std::tmpfile(), true, "{msg}");
+    slog::AsyncOptions opt;
+    opt.on_fork_child = [&file, &fds] { file.reopen(fdopen(fds[1], "w"), true); };
+    slog::AsyncSink async(file, opt);
+    SLOG(INFO, async, "before the fork");
+    pid_t pid = fork();
+    REQUIRE_NE(pid, -1);
+    if (pid == 0)
+    {
+        close(fds[0]);
+        SLOG(INFO, async, "in the child");
+        async.flush();
+        file.flush();
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string out;
+    char buf[256];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+    {
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+    close(fds[0]);
+    CHECK(reap(pid));
+    // what the parent logged was written out before the fork, so the child has no copy of it to write again
+    CHECK_EQ(out, "in the child\n");
+}
+
+TEST_CASE("a fork gives up on a stuck target at the deadline and leaves its records queued")
+{
+    GatedSink gated;
+    slog::AsyncSink async(gated);
+    stall(gated, async);
+    {
+        slog::ScopedTag req("req", 7);
+        SLOG(INFO, async, "behind the stall");
+    }
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    REQUIRE_NE(pid, -1);
+    if (pid == 0)
+    {
+        // the forking thread held the gate, so the child can open it; the parent's queued records aren't the child's to write
+        gated.gate.unlock();
+        SLOG(INFO, async, "in the child");
+        async.flush();
+        _exit(gated.lines.size() == 1 && gated.lines[0] == "in the child" ? 0 : 1);
+    }
+    auto waited = std::chrono::steady_clock::now() - start;
+    CHECK(waited >= std::chrono::milliseconds(SLOG_FORK_TIMEOUT_MS));
+    CHECK(waited < std::chrono::milliseconds(SLOG_FORK_TIMEOUT_MS) + std::chrono::seconds(1));
+    CHECK(reap(pid));
+    gated.gate.unlock();
+    async.flush();
+    REQUIRE_EQ(gated.lines.size(), 2);
+    CHECK_EQ(gated.lines[1], "behind the stall req=7");
+}
+
+TEST_CASE("on_fork_child can make and destroy sinks")
+{
+    CountSink counts;
+    slog::AsyncOptions opt;
+    opt.on_fork_child = [] {
+        CountSink other;
+        slog::AsyncSink async(other);
+        SLOG(INFO, async, "c");
+        async.flush();
+        if (other.child.load() != 1)
+        {
+            _exit(1);
+        }
+    };
+    slog::AsyncSink async(counts, opt);
+    pid_t pid = fork();
+    REQUIRE_NE(pid, -1);
+    if (pid == 0)
+    {
+        SLOG(INFO, async, "c");
+        async.flush();
+        _exit(counts.child.load() == 1 ? 0 : 1);
+    }
+    CHECK(reap(pid));
+}
+#endif
@@ -32,4 +32,171 @@ TEST_CASE("stream-style logging works")
     CHECK_EQ(record.ctx.line, line);
     CHECK_EQ(record.sev, slog::Severity::DEBUG);
     CHECK_EQ(record.msg, "foo");
-}
\ No newline at end of file
+}
+TEST_CASE("patterns render every field in order")
+{
+    slog::Context ctx = slog::make_ctx("foo.cpp", 42, "bar");
+    std::string out;
+    slog::Pattern("[{sev}] {file}:{line} {func}: {msg} {{{nope}}}").render(out, slog::Severity::WARN, ctx, "hi");
+    CHECK_EQ(out, "[WARN] foo.cpp:42 bar: hi {{nope}}");
+
+    out.clear();
+    slog::Pattern("{time:%Y.%f}").render(out, slog::Severity::WARN, ctx, "hi");
+    CHECK_EQ(out.size(), 11);
+    CHECK_EQ(out[4], '.');
+}
+
+TEST_CASE("static patterns match their runtime counterparts")
+{
+    namespace p = slog::pattern;
+    slog::Context ctx = slog::make_ctx("foo.cpp", 42, "bar");
+    std::string dynamic, fixed;
+    slog::Pattern("{time}\t{sev} {tid} {file}:{line} {msg}").render(dynamic, slog::Severity::INFO, ctx, "hi");
+    slog::StaticPattern<p::Time<>, p::Lit<'\t'>, p::Sev, p::Lit<' '>, p::Tid, p::Lit<' '>, p::File, p::Lit<':'>, p::Line, p::Lit<' '>, p::Msg>()
+        .render(fixed, slog::Severity::INFO, ctx, "hi");
+    CHECK_EQ(dynamic, fixed);
+}
+
+TEST_CASE("key-value logging falls back to logfmt for plain sinks")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    std::string who = "a b";
+    SLOG_KV(INFO, "done", "latency_us", 12u, "delta", -3, "ratio", 0.5, "ok", true, "who", who);
+    LogRecord record = sink.records.back();
+    sink.records.pop_back();
+    CHECK_EQ(record.sev, slog::Severity::INFO);
+    CHECK_EQ(record.msg, "done latency_us=12 delta=-3 ratio=0.5 ok=true who=\"a b\"");
+}
+
+TEST_CASE("logfmt quotes and escapes control bytes, so a value can't add a line")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    std::string forged = "ok\nERROR forged=1\r\tend\x01";
+    SLOG_KV(INFO, "done", "who", forged, "plain", "a\\b");
+    LogRecord record = sink.records.back();
+    sink.records.pop_back();
+    CHECK_EQ(record.msg, "done who=\"ok\\nERROR forged=1\\r\\tend\\x01\" plain=a\\b");
+    CHECK_EQ(record.msg.find('\n'), std::string::npos);
+}
+
+TEST_CASE("stream formatting state doesn't leak into the next record")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    SLOG(DEBUG) << std::hex << 255;
+    SLOG(DEBUG) << 255;
+    REQUIRE_GE(sink.records.size(), 2);
+    CHECK_EQ(sink.records[sink.records.size() - 2].msg, "ff");
+    CHECK_EQ(sink.records.back().msg, "255");
+    sink.records.clear();
+}
+
+TEST_CASE("site stats rank call sites by volume")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    SLOG(INFO, "not counted");
+    slog::site_stats_reset();
+    slog::site_stats_enable(true);
+    int chatty = -1, quiet = -1;
+    for (int i = 0; i < 3; i++)
+    {
+        SLOG(INFO, "twelve bytes"); chatty = __LINE__;
+    }
+    SLOG(WARN) << "1234567890123456789012345678901234567890"; quiet = __LINE__;
+    slog::site_stats_enable(false);
+    SLOG(INFO, "not counted either");
+    sink.records.clear();
+
+    std::vector<slog::SiteStats> by_bytes = slog::top_sites(2);
+    REQUIRE_EQ(by_bytes.size(), 2);
+    CHECK_EQ(by_bytes[0].line, quiet);
+    CHECK_EQ(by_bytes[0].bytes, 40);
+    CHECK_EQ(by_bytes[1].line, chatty);
+    CHECK_EQ(by_bytes[1].records, 3);
+    CHECK_EQ(by_bytes[1].bytes, 36);
+    std::vector<slog::SiteStats> by_records = slog::top_sites(1, false);
+    REQUIRE_EQ(by_records.size(), 1);
+    CHECK_EQ(by_records[0].line, chatty);
+    CHECK_EQ(std::string(by_records[0].func_name), __FUNCTION__);
+    CHECK_EQ(slog::site_stats_overflow(), 0);
+}
+
+TEST_CASE("timed scopes log their duration on exit")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    sink.records.clear();
+    int line = -1;
+    {
+        SLOG_TIMED(INFO, "work"); line = __LINE__;
+        CHECK(sink.records.empty());
+    }
+    REQUIRE_EQ(sink.records.size(), 1);
+    CHECK_EQ(sink.records[0].sev, slog::Severity::INFO);
+    CHECK_EQ(sink.records[0].ctx.line, line);
+    CHECK_EQ(sink.records[0].msg.find("work elapsed_us="), 0);
+    sink.records.clear();
+
+    MockSink other;
+    {
+        SLOG_TIMED(WARN, "fast", std::chrono::hours(1));
+        SLOG_TIMED(WARN, "slow", other, std::chrono::nanoseconds(0));
+    }
+    CHECK(sink.records.empty());
+    CHECK_EQ(other.records.size(), 1);
+}
+
+namespace
+{
+std::string tags_of(const slog::Context &ctx)
+{
+    std::string out;
+    slog::Pattern("{tags}").render(out, slog::Severity::INFO, ctx, "");
+    return out;
+}
+void nest(int depth, int &seen)
+{
+    slog::ScopedTag tag("depth", depth);
+    if (depth > 1)
+    {
+        nest(depth - 1, seen);
+        return;
+    }
+    for (const slog::Field &f : slog::make_ctx("foo.cpp", 1, "bar").tags)
+    {
+        seen += f.key == std::string("depth") ? 1 : 0;
+    }
+}
+} // namespace
+
+TEST_CASE("scoped tags nest and are seen by sinks")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    sink.records.clear();
+    {
+        slog::ScopedTag req("req", 42);
+        {
+            slog::ScopedTag tenant("tenant", std::string("acme corp"));
+            SLOG(INFO, "inner");
+            CHECK_EQ(tags_of(sink.records.back().ctx), " req=42 tenant=\"acme corp\"");
+            slog::Tags::iterator it = sink.records.back().ctx.tags.begin();
+            CHECK_EQ(std::string(it->key), "tenant");
+            CHECK_EQ(std::string((++it)->key), "req");
+        }
+        SLOG(INFO, "outer");
+        CHECK_EQ(tags_of(sink.records.back().ctx), " req=42");
+    }
+    SLOG(INFO, "none");
+    CHECK(sink.records.back().ctx.tags.empty());
+    sink.records.clear();
+
+    std::string long_value(100, 'x');
+    slog::ScopedTag shard("shard", long_value);
+    CHECK_EQ(tags_of(slog::make_ctx("foo.cpp", 1, "bar")), " shard=" + std::string(SLOG_TAG_TEXT, 'x'));
+}
+
+TEST_CASE("scoped tags past the pool size still work")
+{
+    int seen = 0;
+    nest(SLOG_TAG_FRAMES + 8, seen);
+    CHECK_EQ(seen, SLOG_TAG_FRAMES + 8);
+    CHECK(slog::make_ctx("foo.cpp", 1, "bar").tags.empty());
+}
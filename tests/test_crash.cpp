@@ -0,0 +1,162 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <slog_crash.hpp>
+
+#include <string>
+#include <sys/wait.h>
+
+namespace
+{
+/** a target that never returns, so everything after the first record stays queued */
+struct StuckSink : public slog::Sink
+{
+    std::mutex gate;
+    std::atomic<int> entered{0};
+    void record(slog::Severity, const slog::Context &, const std::string &) override
+    {
+        entered++;
+        std::lock_guard<std::mutex> lock(gate);
+    }
+};
+
+/** runs child in a forked process with its output going to a pipe, and returns that output and how the child ended */
+template <typename F> std::string in_child(F child, int &status)
+{
+    int fds[2];
+    REQUIRE_EQ(pipe(fds), 0);
+    pid_t pid = fork();
+    REQUIRE_NE(pid, -1);
+    if (pid == 0)
+    {
+        close(fds[0]);
+        child(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string out;
+    char buf[512];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+    {
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    return out;
+}
+
+void crash_with_a_backlog(int fd)
+{
+    StuckSink stuck;
+    stuck.gate.lock();
+    slog::AsyncSink async(stuck);
+    SLOG(INFO, async, "stuck");
+    while (stuck.entered.load() == 0)
+    {
+        std::this_thread::yield();
+    }
+    slog::ScopedTag req("req", 7);
+    SLOG_KV(WARN, async, "queued", "i", 1, "ratio", 0.25, "name", std::string("abc"));
+    SLOG(ERROR, async) << "last words";
+    slog::install_crash_handler(fd);
+    raise(SIGSEGV);
+}
+
+int exit_code = 0;
+void previous_handler(int)
+{
+    _exit(exit_code);
+}
+} // namespace
+
+TEST_CASE("the crash handler writes out queued records, then lets the signal end the process")
+{
+    int status = 0;
+    std::string out = in_child(
+        [](int fd) {
+            // rather than doctest's or a sanitizer's
+            signal(SIGSEGV, SIG_DFL);
+            crash_with_a_backlog(fd);
+        },
+        status);
+    CHECK(WIFSIGNALED(status));
+    CHECK_EQ(WTERMSIG(status), SIGSEGV);
+    CHECK(out.find("slog: caught SIGSEGV") == 0);
+    CHECK(out.find("\tWARN\t") != std::string::npos);
+    CHECK(out.find("queued i=1 ratio=0.250000 name=abc req=7\n") != std::string::npos);
+    CHECK(out.find("last words req=7\n") != std::string::npos);
+    CHECK(out.find("queued") < out.find("last words"));
+    CHECK(out.find("slog: done\n") != std::string::npos);
+}
+
+TEST_CASE("the crash handler hands the signal on to the handler it replaced")
+{
+    int status = 0;
+    std::string out = in_child(
+        [](int fd) {
+            exit_code = 42;
+            signal(SIGSEGV, previous_handler);
+            crash_with_a_backlog(fd);
+        },
+        status);
+    CHECK(WIFEXITED(status));
+    CHECK_EQ(WEXITSTATUS(status), 42);
+    CHECK(out.find("last words") != std::string::npos);
+}
+
+TEST_CASE("visiting the queues while a thread logs into them leaves them as they were")
+{
+    StuckSink stuck;
+    stuck.gate.lock();
+    slog::AsyncSink async(stuck);
+    SLOG(INFO, async, "stuck");
+    while (stuck.entered.load() == 0)
+    {
+        std::this_thread::yield();
+    }
+    std::atomic<bool> done{false};
+    std::thread producer([&async, &done]() {
+        for (int i = 0; i < 2000; i++)
+        {
+            SLOG_KV(INFO, async, "queued", "i", i, "name", std::string("abc"));
+        }
+        done = true;
+    });
+    std::size_t visits = 0;
+    auto count = [&visits](slog::Severity, const slog::Context &, const char *, std::size_t, const slog::Fields &) { visits++; };
+    while (!done.load())
+    {
+        slog::AsyncSink::visit_all_queued(count);
+    }
+    producer.join();
+    visits = 0;
+    std::size_t intact = 0;
+    auto check = [&](slog::Severity, const slog::Context &, const char *msg, std::size_t size, const slog::Fields &fields) {
+        visits++;
+        intact += std::string(msg, size) == "queued" && fields.size() == 2 && std::string(fields[1].str.data, fields[1].str.size) == "abc";
+    };
+    CHECK(slog::AsyncSink::visit_all_queued(check));
+    // the stuck record is still queued until the target returns
+    CHECK_EQ(visits, 2001);
+    CHECK_EQ(intact, 2000);
+    stuck.gate.unlock();
+    async.flush();
+    CHECK_EQ(stuck.entered.load(), 2001);
+}
+
+TEST_CASE("crash timestamps are UTC")
+{
+    slog::detail::SafeWriter out;
+    int fds[2];
+    REQUIRE_EQ(pipe(fds), 0);
+    out.set_fd(fds[1]);
+    // 2024-02-29T23:59:59.000123Z
+    out.time(std::chrono::system_clock::time_point(std::chrono::microseconds(1709251199000123LL))).chr(' ').dbl(-1.5).chr(' ').sint(-12);
+    out.flush();
+    close(fds[1]);
+    char buf[64] = {};
+    REQUIRE_GT(read(fds[0], buf, sizeof(buf) - 1), 0);
+    close(fds[0]);
+    CHECK_EQ(std::string(buf), "2024-02-29T23:59:59.000123Z -1.500000 -12");
+}
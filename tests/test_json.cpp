@@ -0,0 +1,56 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <slog_json.hpp>
+
+TEST_CASE("json escaping handles quotes, backslashes and control bytes")
+{
+    std::string out;
+    slog::detail::append_json_string(out, "a\"b\\c\n\x01\xc3\xa9", 9);
+    CHECK_EQ(out, "\"a\\\"b\\\\c\\n\\u0001\xc3\xa9\"");
+}
+
+TEST_CASE("simd json escaping matches the scalar path at every offset")
+{
+    std::string input;
+    for (int i = 0; i < 300; i++)
+    {
+        // mostly plain text with specials sprinkled across 16 and 32 byte boundaries, plus high bytes
+        input += (i % 37 == 0) ? '"' : (i % 41 == 0) ? '\\' : (i % 29 == 0) ? '\t' : (i % 13 == 0) ? '\xe2' : char('a' + i % 26);
+    }
+    for (std::size_t len = 0; len <= input.size(); len++)
+    {
+        std::string simd, scalar;
+        slog::detail::append_json_escaped(simd, input.data(), len);
+        slog::detail::append_json_escaped_scalar(scalar, input.data(), len);
+        REQUIRE_EQ(simd, scalar);
+    }
+}
+
+TEST_CASE("json sink renders one object per record")
+{
+    slog::Context ctx = slog::make_ctx("foo.cpp", 42, "bar");
+    std::string out;
+    slog::JsonSink::render(out, slog::Severity::ERROR, ctx, "say \"hi\"");
+    CHECK_EQ(out.find("{\"time\":\""), 0);
+    CHECK_NE(out.find("\"sev\":\"ERROR\",\"file\":\"foo.cpp\",\"line\":42,\"func\":\"bar\",\"tid\":"), std::string::npos);
+    CHECK_NE(out.find(",\"msg\":\"say \\\"hi\\\"\"}"), std::string::npos);
+}
+
+TEST_CASE("json sink nests structured fields")
+{
+    slog::Context ctx = slog::make_ctx("foo.cpp", 42, "bar");
+    slog::Field fields[] = {slog::detail::make_field("status", 200), slog::detail::make_field("path", "/\"x\"")};
+    std::string out;
+    slog::JsonSink::render(out, slog::Severity::INFO, ctx, "done", slog::Fields(fields, 2));
+    CHECK_NE(out.find(",\"msg\":\"done\",\"fields\":{\"status\":200,\"path\":\"/\\\"x\\\"\"}}"), std::string::npos);
+}
+
+TEST_CASE("json sink nests scoped tags")
+{
+    slog::ScopedTag req("req", 42);
+    slog::ScopedTag tenant("tenant", "acme");
+    std::string out;
+    slog::JsonSink::render(out, slog::Severity::INFO, slog::make_ctx("foo.cpp", 42, "bar"), "done");
+    CHECK_NE(out.find(",\"msg\":\"done\",\"tags\":{\"req\":42,\"tenant\":\"acme\"}}"), std::string::npos);
+}
@@ -0,0 +1,104 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#define SLOG_STRIP_BELOW INFO
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <thread>
+
+namespace
+{
+int evaluations = 0;
+std::string expensive()
+{
+    evaluations++;
+    return "expensive";
+}
+bool condition()
+{
+    evaluations++;
+    return true;
+}
+MockSink &default_sink() { return static_cast<MockSink &>(slog::DEFAULT_SINK()); }
+} // namespace
+
+TEST_CASE("compile time filtered records evaluate nothing")
+{
+    evaluations = 0;
+    default_sink().records.clear();
+    MockSink sink;
+    SLOG(DEBUG, expensive());
+    SLOG(DEBUG) << expensive();
+    SLOG(DEBUG, sink, expensive());
+    SLOG(DEBUG, sink) << expensive();
+    SLOG_IF(DEBUG, condition()) << expensive();
+    SLOG_KV(DEBUG, "msg", "key", expensive());
+    CHECK_EQ(evaluations, 0);
+    CHECK(default_sink().records.empty());
+    CHECK(sink.records.empty());
+    CHECK_FALSE(SLOG_ENABLED(DEBUG));
+    CHECK_FALSE(SLOG_ENABLED(DEBUG, sink));
+}
+
+TEST_CASE("runtime filtered records evaluate nothing")
+{
+    evaluations = 0;
+    default_sink().records.clear();
+    MockSink sink;
+    slog::set_min_severity(slog::Severity::WARN);
+    SLOG(INFO, expensive());
+    SLOG(INFO) << expensive();
+    SLOG(INFO, sink, expensive());
+    SLOG(INFO, sink) << expensive();
+    SLOG_IF(INFO, condition()) << expensive();
+    SLOG_KV(INFO, "msg", "key", expensive());
+    CHECK_EQ(evaluations, 0);
+    CHECK_FALSE(SLOG_ENABLED(INFO));
+    CHECK(SLOG_ENABLED(WARN));
+
+    SLOG_IF(WARN, condition()) << expensive();
+    CHECK_EQ(evaluations, 2);
+    slog::set_min_severity(slog::Severity::DEBUG);
+    SLOG(INFO, sink) << expensive();
+    CHECK_EQ(evaluations, 3);
+    CHECK_EQ(default_sink().records.size(), 1);
+    CHECK_EQ(sink.records.size(), 1);
+}
+
+TEST_CASE("a sink's own level filters records and SLOG_ENABLED")
+{
+    MockSink sink;
+    sink.set_min_severity(slog::Severity::ERROR);
+    CHECK_FALSE(SLOG_ENABLED(WARN, sink));
+    CHECK(SLOG_ENABLED(WARN));
+    CHECK(SLOG_ENABLED(ERROR, sink));
+    SLOG(WARN, sink, "dropped");
+    SLOG_KV(WARN, sink, "dropped", "key", 1);
+    SLOG(ERROR, sink, "kept");
+    REQUIRE_EQ(sink.records.size(), 1);
+    CHECK_EQ(sink.records[0].msg, "kept");
+}
+
+TEST_CASE("thread severity overrides win over the global level on their own thread only")
+{
+    slog::set_min_severity(slog::Severity::WARN);
+    bool other_info = true;
+    {
+        slog::ScopedSeverity verbose(slog::Severity::INFO);
+        CHECK(SLOG_ENABLED(INFO));
+        std::thread([&] { other_info = SLOG_ENABLED(INFO); }).join();
+        CHECK_FALSE(other_info);
+        {
+            slog::ScopedSeverity quiet(slog::Severity::ERROR);
+            CHECK_FALSE(SLOG_ENABLED(WARN));
+            bool other_warn = false;
+            std::thread([&] { other_warn = SLOG_ENABLED(WARN); }).join();
+            CHECK(other_warn);
+        }
+        evaluations = 0;
+        SLOG(INFO) << expensive();
+        CHECK_EQ(evaluations, 1);
+    }
+    CHECK_FALSE(SLOG_ENABLED(INFO));
+    // with no overrides left the bounds collapse back onto the global level
+    CHECK_EQ(slog::detail::levels().word.load(), (int(slog::Severity::WARN) << 8) | int(slog::Severity::WARN));
+    slog::set_min_severity(slog::Severity::DEBUG);
+}
@@ -0,0 +1,61 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#define SLOG_METRICS 1
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <slog_async.hpp>
+#include <slog_metrics.hpp>
+
+#include <thread>
+
+TEST_CASE("metrics count records and bytes, fields and tags included, per severity across threads")
+{
+    MockSink sink;
+    slog::Metrics before = slog::metrics_snapshot();
+    std::thread other([&] {
+        slog::ScopedTag req("req", 42);
+        SLOG(ERROR, sink, "12345");
+    });
+    other.join();
+    SLOG(INFO, sink, "1234");
+    SLOG(INFO, sink) << "12";
+    SLOG_KV(WARN, sink, "1", "key", 1);
+    slog::Metrics delta = slog::metrics_snapshot().since(before);
+    CHECK_EQ(delta.records[static_cast<int>(slog::Severity::DEBUG)], 0);
+    CHECK_EQ(delta.records[static_cast<int>(slog::Severity::INFO)], 2);
+    CHECK_EQ(delta.records[static_cast<int>(slog::Severity::WARN)], 1);
+    CHECK_EQ(delta.records[static_cast<int>(slog::Severity::ERROR)], 1);
+    // fields and tags count as logfmt: "12345 req=42", "1234", "12", "1 key=1"
+    CHECK_EQ(delta.bytes, 25);
+    unsigned long long timed = 0;
+    for (unsigned long long n : delta.record_ns)
+    {
+        timed += n;
+    }
+    CHECK_EQ(timed, 4);
+    CHECK_GT(delta.record_ns_quantile(0.99), 0);
+}
+
+TEST_CASE("async sinks raise the queue high-water mark")
+{
+    MockSink sink;
+    {
+        slog::AsyncSink async(sink);
+        for (int i = 0; i < 10; i++)
+        {
+            SLOG(INFO, async, "queued");
+        }
+    }
+    CHECK_GE(slog::metrics_snapshot().queue_high_water, 1);
+}
+
+TEST_CASE("the reporter logs metrics as fields")
+{
+    MockSink out;
+    slog::MetricsReporter reporter(out, std::chrono::milliseconds(1000));
+    slog::Metrics m = slog::Metrics();
+    m.records[1] = 3;
+    m.bytes = 10;
+    reporter.report(m);
+    REQUIRE_EQ(out.records.size(), 1);
+    CHECK_EQ(out.records[0].msg.find("slog metrics records=3 debug=0 info=3 warn=0 error=0 bytes=10 dropped=0"), 0);
+}
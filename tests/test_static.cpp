@@ -0,0 +1,63 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <slog_static.hpp>
+
+struct StringWriter
+{
+    std::string out;
+    void write(const char *data, std::size_t size) { out.append(data, size); }
+};
+
+namespace p = slog::pattern;
+typedef slog::Format<slog::StaticPattern<p::Sev, p::Lit<' '>, p::Msg>, StringWriter> Lines;
+
+TEST_CASE("static chains filter and format without a vtable")
+{
+    slog::MinSeverity<slog::Severity::INFO, Lines> chain;
+    SLOG(DEBUG, chain, "dropped");
+    SLOG(INFO, chain, "kept");
+    SLOG(WARN, chain) << "stream " << 1;
+    SLOG_KV(ERROR, chain, "kv", "code", 7);
+    CHECK_EQ(chain.next.writer.out, "INFO kept\nWARN stream 1\nERROR kv code=7\n");
+}
+
+TEST_CASE("static fanouts can end in a virtual sink")
+{
+    MockSink mock;
+    slog::Fanout<Lines, slog::SinkRef> both{Lines(), slog::SinkRef(mock)};
+    SLOG(INFO, both, "hello");
+    CHECK_EQ(both.first.writer.out, "INFO hello\n");
+    REQUIRE_EQ(mock.records.size(), 1);
+    CHECK_EQ(mock.records[0].msg, "hello");
+}
+
+namespace
+{
+struct AtLeastWarn
+{
+    static bool pass(slog::Severity sev, const slog::Context &) { return sev >= slog::Severity::WARN; }
+};
+} // namespace
+
+TEST_CASE("static chains can be copied")
+{
+    typedef slog::MinSeverity<slog::Severity::INFO, slog::Filter<AtLeastWarn, Lines>> Chain;
+    Chain chain;
+    SLOG(WARN, chain, "before");
+    // non-const lvalues, which a forwarding constructor would otherwise take for arguments to next
+    Chain copy(chain);
+    Chain assigned;
+    assigned = chain;
+    slog::Fanout<Chain> fanout;
+    slog::Fanout<Chain> fanout_copy(fanout);
+    const Chain &cref = chain;
+    Chain from_const(cref);
+    SLOG(INFO, copy, "dropped");
+    SLOG(ERROR, copy, "after");
+    CHECK_EQ(chain.next.next.writer.out, "WARN before\n");
+    CHECK_EQ(copy.next.next.writer.out, "WARN before\nERROR after\n");
+    CHECK_EQ(assigned.next.next.writer.out, "WARN before\n");
+    CHECK_EQ(from_const.next.next.writer.out, "WARN before\n");
+    CHECK(fanout_copy.first.next.next.writer.out.empty());
+}
@@ -0,0 +1,123 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "mock_slog.hpp"
+#include <slog_trace.hpp>
+
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <thread>
+#if SLOG_ATFORK == 1
+#include <sys/wait.h>
+#endif
+
+static std::size_t count(const std::string &haystack, const std::string &needle)
+{
+    std::size_t n = 0;
+    for (std::size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1))
+    {
+        n++;
+    }
+    return n;
+}
+/** reads a trace file written by TraceSink from the start, then closes it */
+static std::string read_all(std::FILE *file)
+{
+    std::rewind(file);
+    std::string json;
+    char buf[512];
+    for (std::size_t n; (n = std::fread(buf, 1, sizeof(buf), file)) > 0;)
+    {
+        json.append(buf, n);
+    }
+    std::fclose(file);
+    return json;
+}
+
+TEST_CASE("spans and instants reach ordinary sinks as fields")
+{
+    MockSink &sink = static_cast<MockSink&>(slog::DEFAULT_SINK());
+    sink.records.clear();
+    {
+        SLOG_SPAN(INFO, "outer");
+        SLOG_INSTANT(WARN, "tick", "n", 1);
+    }
+    REQUIRE_EQ(sink.records.size(), 3);
+    CHECK_EQ(sink.records[0].msg, "outer trace=begin");
+    CHECK_EQ(sink.records[1].msg, "tick trace=instant n=1");
+    CHECK_EQ(sink.records[2].msg, "outer trace=end");
+    sink.records.clear();
+}
+
+TEST_CASE("trace sinks write chrome trace events with a track per thread")
+{
+    std::FILE *file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    {
+        slog::TraceSink trace(file);
+        {
+            SLOG_SPAN(INFO, "request", trace);
+            SLOG_INSTANT(INFO, trace, "cache miss", "key", "a\"b");
+            std::thread([&] { SLOG_SPAN(DEBUG, "worker", trace); }).join();
+            SLOG(ERROR, trace, "plain record");
+        }
+    }
+    std::string json = read_all(file);
+
+    CHECK_EQ(json.front(), '[');
+    CHECK_EQ(json.substr(json.size() - 3), "\n]\n");
+    CHECK_EQ(count(json, "\"ph\":\"B\""), 2);
+    CHECK_EQ(count(json, "\"ph\":\"E\""), 2);
+    CHECK_EQ(count(json, "\"ph\":\"i\""), 2);
+    CHECK_NE(json.find("\"name\":\"cache miss\",\"cat\":\"INFO\",\"ph\":\"i\",\"s\":\"t\""), std::string::npos);
+    CHECK_NE(json.find("\"args\":{\"key\":\"a\\\"b\"},\"tid\":1}"), std::string::npos);
+    CHECK_NE(json.find("\"name\":\"worker\",\"cat\":\"DEBUG\",\"ph\":\"B\""), std::string::npos);
+    CHECK_EQ(count(json, "\"tid\":2}"), 2);
+    CHECK_EQ(json.find("trace"), std::string::npos);
+}
+
+TEST_CASE("trace sinks write non-finite args as null, which trace viewers accept")
+{
+    std::FILE *file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    {
+        slog::TraceSink trace(file);
+        SLOG_INSTANT(INFO, trace, "ratios", "nan", std::numeric_limits<double>::quiet_NaN(), "inf",
+                     -std::numeric_limits<double>::infinity(), "half", 0.5);
+    }
+    std::string json = read_all(file);
+    CHECK_NE(json.find("\"args\":{\"nan\":null,\"inf\":null,\"half\":0.5}"), std::string::npos);
+}
+
+#if SLOG_ATFORK == 1
+TEST_CASE("trace sinks write a forked child's events under the child's pid")
+{
+    std::FILE *file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    pid_t pid;
+    {
+        slog::TraceSink trace(file);
+        SLOG_INSTANT(INFO, trace, "parent");
+        // or the child writes out its copy of the buffer too
+        trace.flush();
+        pid = fork();
+        REQUIRE_NE(pid, -1);
+        if (pid == 0)
+        {
+            SLOG_INSTANT(INFO, trace, "child");
+            trace.flush();
+            _exit(0);
+        }
+        int status = 0;
+        REQUIRE_EQ(waitpid(pid, &status, 0), pid);
+        CHECK(WIFEXITED(status));
+        SLOG_INSTANT(INFO, trace, "parent again");
+    }
+    std::string json = read_all(file);
+    std::string parent = ",\"pid\":" + std::to_string(getpid()) + ",";
+    std::string child = ",\"pid\":" + std::to_string(pid) + ",";
+    CHECK_EQ(count(json, parent), 2);
+    CHECK_EQ(count(json, child), 1);
+    CHECK_LT(json.find(parent), json.find(child));
+}
+#endif